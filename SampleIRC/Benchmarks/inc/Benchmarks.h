@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct BenchmarkResult
+{
+	std::string benchmark;
+	std::string parameters;
+	double value;
+	std::string unit;
+};
+
+auto ReportResult(const BenchmarkResult& result) -> void;
+auto ArgumentOr(const std::vector<std::string>& args, size_t index, size_t fallback) -> size_t;
+
+auto RunShardingBenchmark(const std::vector<std::string>& args) -> void;
+auto RunQueueBenchmark(const std::vector<std::string>& args) -> void;
+auto RunMessageBenchmark(const std::vector<std::string>& args) -> void;
+auto RunChannelBenchmark(const std::vector<std::string>& args) -> void;
+auto RunLogBenchmark(const std::vector<std::string>& args) -> void;
+auto RunCompressionBenchmark(const std::vector<std::string>& args) -> void;
+auto RunWireFormatBenchmark(const std::vector<std::string>& args) -> void;
+auto RunTimerWheelBenchmark(const std::vector<std::string>& args) -> void;
+auto RunJournalBenchmark(const std::vector<std::string>& args) -> void;
+auto RunConnectionBenchmark(const std::vector<std::string>& args) -> void;
+auto RunFanoutBenchmark(const std::vector<std::string>& args) -> void;
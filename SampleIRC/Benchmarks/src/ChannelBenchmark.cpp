@@ -0,0 +1,84 @@
+#include "Benchmarks.h"
+
+#include <Framework/ChannelIndex.h>
+
+#include <random>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto NanosecondsPer(Clock::time_point start, size_t operations) -> double
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / operations;
+	}
+}
+
+// Arguments: [users=100000] [channels=10000] [channelsPerUser=5] [messages=100000]
+auto RunChannelBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t users = ArgumentOr(args, 0, 100000);
+	const size_t channelCount = ArgumentOr(args, 1, 10000);
+	const size_t channelsPerUser = ArgumentOr(args, 2, 5);
+	const size_t messages = ArgumentOr(args, 3, 100000);
+
+	const std::string parameters = "users=" + std::to_string(users) +
+								   " channels=" + std::to_string(channelCount) +
+								   " perUser=" + std::to_string(channelsPerUser);
+
+	std::vector<std::string> names;
+	for (size_t i = 0; i < channelCount; i++)
+		names.push_back("#room" + std::to_string(i));
+
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> pickChannel(0, channelCount - 1);
+	std::uniform_int_distribution<uint32_t> pickUser(0, static_cast<uint32_t>(users - 1));
+
+	IRC::ChannelIndex<uint32_t> index;
+
+	auto start = Clock::now();
+	for (uint32_t user = 0; user < users; user++)
+	{
+		for (size_t i = 0; i < channelsPerUser; i++)
+			index.Join(names[pickChannel(random)], user, user);
+	}
+	ReportResult({ "channels.join", parameters, NanosecondsPer(start, users * channelsPerUser), "ns/join" });
+
+	// Part and rejoin random memberships to exercise the swap-remove bookkeeping.
+	start = Clock::now();
+	for (size_t i = 0; i < messages; i++)
+	{
+		const uint32_t user = pickUser(random);
+		const std::string& name = names[pickChannel(random)];
+		index.Part(name, user);
+		index.Join(name, user, user);
+	}
+	ReportResult({ "channels.part_join", parameters, NanosecondsPer(start, messages), "ns/part+join" });
+
+	// Fan-out: a message to a random channel touches only that channel's member slots.
+	size_t delivered = 0;
+	uint64_t checksum = 0;
+	start = Clock::now();
+	for (size_t i = 0; i < messages; i++)
+	{
+		auto channel = index.FindChannel(names[pickChannel(random)]);
+		if (!channel)
+			continue;
+
+		for (const auto& member : index.Members(*channel))
+		{
+			checksum += member.value;
+			delivered++;
+		}
+	}
+	ReportResult({ "channels.fanout", parameters, NanosecondsPer(start, messages), "ns/message" });
+	ReportResult({ "channels.fanout.members", parameters, static_cast<double>(delivered) / messages, "members/message" });
+
+	start = Clock::now();
+	for (uint32_t user = 0; user < users; user++)
+		index.PartAll(user);
+	ReportResult({ "channels.part_all", parameters, NanosecondsPer(start, users), "ns/user" });
+
+	volatile uint64_t sink = checksum + index.MembershipCount();
+	(void)sink;
+}
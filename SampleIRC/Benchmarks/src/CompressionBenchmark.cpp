@@ -0,0 +1,106 @@
+#include "Benchmarks.h"
+
+#include <Framework/Compression.h>
+
+#include <random>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Chat-like text: relayed lines with a timestamp, a nick, a channel and a few words from a small
+	// vocabulary, which is roughly the redundancy of a real channel's scrollback.
+	auto MakeChatText(size_t bytes, std::mt19937& random) -> std::string
+	{
+		static const char* nicks[] = { "alice", "bob", "carol", "dave", "eve", "mallory", "trent", "peggy", "victor", "walter" };
+		static const char* channels[] = { "#general", "#random", "#dev", "#ops" };
+		static const char* words[] =
+		{
+			"the", "a", "is", "to", "and", "of", "it", "that", "in", "you", "this", "for", "on", "with", "just",
+			"build", "deploy", "server", "client", "broken", "works", "again", "today", "lol", "yeah", "no",
+			"please", "review", "merge", "ticket", "latency", "queue", "shard", "restart", "log", "error", "fixed",
+			"anyone", "seen", "why", "does", "after", "before", "morning", "thanks", "ok", "sure", "ping", "me"
+		};
+
+		std::string text;
+		unsigned seconds = 0;
+		while (text.size() < bytes)
+		{
+			seconds += random() % 20;
+			char prefix[64];
+			std::snprintf(prefix, sizeof(prefix), "[%02u:%02u:%02u] %s <%s> ", (seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60,
+						  channels[random() % std::size(channels)], nicks[random() % std::size(nicks)]);
+			text += prefix;
+
+			const size_t wordCount = 3 + random() % 12;
+			for (size_t w = 0; w < wordCount; w++)
+			{
+				text += words[random() % std::size(words)];
+				text += w + 1 < wordCount ? ' ' : '\n';
+			}
+		}
+		text.resize(bytes);
+		return text;
+	}
+
+	auto MakeRandomBytes(size_t bytes, std::mt19937& random) -> std::string
+	{
+		std::string text(bytes, '\0');
+		for (auto& c : text)
+			c = static_cast<char>(random());
+		return text;
+	}
+
+	// Throughput is over the uncompressed bytes; single-threaded, so ns/KB is the CPU cost.
+	auto MeasureCodec(const std::string& name, const std::string& input, size_t iterations) -> void
+	{
+		const auto* source = reinterpret_cast<const uint8_t*>(input.data());
+		std::vector<uint8_t> compressed(IRC::Lz4::Bound(input.size()));
+		std::vector<uint8_t> restored(input.size());
+
+		size_t compressedSize = 0;
+		const auto compressStart = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			compressedSize = IRC::Lz4::Compress(source, input.size(), compressed.data(), compressed.size());
+		const double compressSeconds = std::chrono::duration<double>(Clock::now() - compressStart).count();
+
+		bool valid = true;
+		const auto decompressStart = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			valid &= IRC::Lz4::Decompress(compressed.data(), compressedSize, restored.data(), restored.size());
+		const double decompressSeconds = std::chrono::duration<double>(Clock::now() - decompressStart).count();
+
+		if (!valid || std::memcmp(restored.data(), source, input.size()) != 0)
+		{
+			ReportResult({ "compression.error", name, 0.0, "roundtrip" });
+			return;
+		}
+
+		const double totalBytes = static_cast<double>(input.size()) * iterations;
+		const std::string parameters = name + " bytes=" + std::to_string(input.size());
+		ReportResult({ "compression.ratio", parameters, static_cast<double>(input.size()) / compressedSize, "x" });
+		ReportResult({ "compression.compress", parameters, totalBytes / compressSeconds / 1e6, "MB/s" });
+		ReportResult({ "compression.decompress", parameters, totalBytes / decompressSeconds / 1e6, "MB/s" });
+		ReportResult({ "compression.compress.cpu", parameters, compressSeconds * 1e9 / (totalBytes / 1024), "ns/KB" });
+		ReportResult({ "compression.decompress.cpu", parameters, decompressSeconds * 1e9 / (totalBytes / 1024), "ns/KB" });
+	}
+}
+
+// Arguments: [megabytesPerCase=64]
+auto RunCompressionBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t megabytes = ArgumentOr(args, 0, 64);
+	std::mt19937 random(42);
+
+	// A single chat line, a scrollback burst on join, a bulk server dump, and incompressible data.
+	const std::pair<std::string, std::string> cases[] =
+	{
+		{ "chat-line", MakeChatText(96, random) },
+		{ "history-burst", MakeChatText(4 * 1024, random) },
+		{ "bulk", MakeChatText(64 * 1024, random) },
+		{ "random", MakeRandomBytes(4 * 1024, random) },
+	};
+
+	for (const auto& [name, input] : cases)
+		MeasureCodec(name, input, std::max<size_t>(1, megabytes * 1024 * 1024 / input.size()));
+}
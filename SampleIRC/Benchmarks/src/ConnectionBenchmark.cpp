@@ -0,0 +1,203 @@
+#include "Benchmarks.h"
+
+#include <Framework/Connection.h>
+#include <Framework/MessageTypes.h>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+	using Link = IRC::Connection<IRCMessageType>;
+	using boost::asio::ip::tcp;
+
+	// A sending and a receiving connection on either end of one socket, each on its own io_context
+	// and thread, the way a server shard and a client would be. Only the receiving end reads.
+	class LinkedPair
+	{
+	public:
+		LinkedPair()
+			: senderGuard(boost::asio::make_work_guard(senderContext)),
+			receiverGuard(boost::asio::make_work_guard(receiverContext))
+		{ }
+
+		~LinkedPair()
+		{
+			if (sender)
+				sender->Disconnect();
+			if (receiver)
+				receiver->Disconnect();
+			senderGuard.reset();
+			receiverGuard.reset();
+			senderContext.stop();
+			receiverContext.stop();
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		auto ConnectLoopback() -> bool
+		{
+			tcp::acceptor acceptor(receiverContext, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+			tcp::socket client(senderContext);
+			tcp::socket server(receiverContext);
+
+			boost::system::error_code ec;
+			client.connect(acceptor.local_endpoint(), ec);
+			if (!ec)
+				acceptor.accept(server, ec);
+			if (ec)
+			{
+				fprintf(stderr, "connection: loopback failed: %s\n", ec.message().c_str());
+				return false;
+			}
+
+			// The server end turns Nagle off itself; the client end would only once connected through it.
+			client.set_option(tcp::no_delay(true), ec);
+			Start(std::move(client), std::move(server));
+			return true;
+		}
+
+		// A Unix socket pair, with no TCP stack underneath. Connection only takes TCP sockets, so the
+		// descriptors are handed over as they are; setting the no-delay option on them just fails.
+		auto ConnectSocketPair() -> bool
+		{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+			boost::asio::local::stream_protocol::socket first(senderContext);
+			boost::asio::local::stream_protocol::socket second(receiverContext);
+
+			boost::system::error_code ec;
+			boost::asio::local::connect_pair(first, second, ec);
+			if (ec)
+			{
+				fprintf(stderr, "connection: socketpair failed: %s\n", ec.message().c_str());
+				return false;
+			}
+
+			tcp::socket client(senderContext);
+			tcp::socket server(receiverContext);
+			client.assign(tcp::v4(), first.release());
+			server.assign(tcp::v4(), second.release());
+			Start(std::move(client), std::move(server));
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// Sends `messages` frames of `payload` bytes as fast as the receiver frames them, with few enough
+		// in flight that the sender's out-queue stays under its watermarks and nothing is dropped.
+		// Returns the seconds it took, or nothing if the receiver stopped making progress.
+		auto Stream(size_t payload, size_t messages) -> std::optional<double>
+		{
+			IRC::Message<IRCMessageType> msg;
+			msg.header.id = IRCMessageType::MessageAll;
+			msg.body.resize(payload);
+			msg.header.size = static_cast<uint32_t>(msg.size());
+			const auto shared = IRC::MakeSharedMessage(msg);
+
+			const uint64_t window = std::clamp<uint64_t>(windowBytes / shared->size(), 1, windowMessages);
+			const uint64_t base = received.load();
+
+			const auto start = Clock::now();
+			for (uint64_t sent = 0; sent <= messages; sent++)
+			{
+				uint64_t arrived = received.load(std::memory_order_relaxed) - base;
+				auto progress = Clock::now();
+				while (sent - arrived >= (sent < messages ? window : 1))
+				{
+					std::this_thread::yield();
+					const uint64_t now = received.load(std::memory_order_relaxed) - base;
+					if (now != arrived)
+					{
+						arrived = now;
+						progress = Clock::now();
+					}
+					else if (Clock::now() - progress > stallTimeout)
+					{
+						fprintf(stderr, "connection: stalled at %llu of %zu messages\n", static_cast<unsigned long long>(arrived), messages);
+						return std::nullopt;
+					}
+				}
+				if (sent < messages)
+					sender->Send(shared);
+			}
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		auto WriteStats() const -> Link::WriteStats
+		{
+			return sender->GetWriteStats();
+		}
+
+		auto ReadStats() const -> Link::ReadStats
+		{
+			return receiver->GetReadStats();
+		}
+
+	private:
+		static constexpr uint64_t windowBytes = 1024 * 1024;
+		static constexpr uint64_t windowMessages = 4096;
+		static constexpr auto stallTimeout = std::chrono::seconds(10);
+
+		auto Start(tcp::socket client, tcp::socket server) -> void
+		{
+			sender = std::make_shared<Link>(Link::Owner::client, senderContext, std::move(client), inQueue);
+			receiver = std::make_shared<Link>(Link::Owner::server, receiverContext, std::move(server), inQueue);
+			receiver->SetOnMessage([this](IRC::IdentifyingMessage<IRCMessageType>&) { received.fetch_add(1, std::memory_order_relaxed); });
+			receiver->ConnectToClient();
+
+			threads.emplace_back([this]() { senderContext.run(); });
+			threads.emplace_back([this]() { receiverContext.run(); });
+		}
+
+		// Stays empty: every message goes to the receiver's callback.
+		IRC::InboundQueue<IRCMessageType> inQueue;
+		boost::asio::io_context senderContext;
+		boost::asio::io_context receiverContext;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> senderGuard;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> receiverGuard;
+		std::shared_ptr<Link> sender;
+		std::shared_ptr<Link> receiver;
+		std::vector<std::thread> threads;
+		std::atomic<uint64_t> received = 0;
+	};
+
+	auto MeasureTransport(const std::string& transport, size_t payload, size_t messages) -> void
+	{
+		LinkedPair pair;
+		if (!(transport == "loopback" ? pair.ConnectLoopback() : pair.ConnectSocketPair()))
+			return;
+
+		if (!pair.Stream(payload, std::min<size_t>(messages / 10, 10000)))
+			return;
+
+		const auto writesBefore = pair.WriteStats();
+		const auto readsBefore = pair.ReadStats();
+		const auto elapsed = pair.Stream(payload, messages);
+		if (!elapsed)
+			return;
+
+		const double seconds = *elapsed;
+		const auto writes = pair.WriteStats();
+		const auto reads = pair.ReadStats();
+
+		const double messagesPerWrite = static_cast<double>(writes.messagesWritten - writesBefore.messagesWritten) / std::max<uint64_t>(writes.writeCalls - writesBefore.writeCalls, 1);
+		const double messagesPerRead = static_cast<double>(reads.messagesRead - readsBefore.messagesRead) / std::max<uint64_t>(reads.readCalls - readsBefore.readCalls, 1);
+
+		const std::string parameters = "transport=" + transport + " payload=" + std::to_string(payload);
+		ReportResult({ "connection.stream", parameters, messages / seconds, "messages/s" });
+		ReportResult({ "connection.stream.bandwidth", parameters, (writes.bytesWritten - writesBefore.bytesWritten) / seconds / 1e6, "MB/s" });
+		ReportResult({ "connection.stream.per_write", parameters, messagesPerWrite, "messages/write" });
+		ReportResult({ "connection.stream.per_read", parameters, messagesPerRead, "messages/read" });
+	}
+}
+
+// Arguments: [messages=1000000]
+auto RunConnectionBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t messages = ArgumentOr(args, 0, 1000000);
+
+	for (const char* transport : { "loopback", "socketpair" })
+	{
+		for (size_t payload : { size_t(16), size_t(256), size_t(4096) })
+			MeasureTransport(transport, payload, payload >= 4096 ? messages / 4 : messages);
+	}
+}
@@ -0,0 +1,134 @@
+#include "Benchmarks.h"
+
+#include <Framework/Journal.h>
+#include <Framework/MessageTypes.h>
+#include <Framework/MessageSchemas.h>
+
+#include <random>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// A fresh directory per run, removed again along with whatever the journal left in it.
+	struct ScratchDirectory
+	{
+		std::filesystem::path path;
+
+		explicit ScratchDirectory(const std::string& name)
+			: path(std::filesystem::temp_directory_path() / ("irc-journal-bench-" + name + "-" + std::to_string(Clock::now().time_since_epoch().count())))
+		{ }
+
+		~ScratchDirectory()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+	};
+
+	auto DurabilityName(IRC::JournalDurability durability) -> const char*
+	{
+		switch (durability)
+		{
+		case IRC::JournalDurability::os: return "os";
+		case IRC::JournalDurability::interval: return "interval";
+		case IRC::JournalDurability::immediate: return "immediate";
+		}
+		return "?";
+	}
+
+	// The server's relay path for a server-wide message: encode once, share the frame, and with a
+	// journal append it there too. Nothing is sent, so what is left is the journal's share.
+	auto MeasureRelay(size_t text, size_t messages, std::optional<IRC::JournalDurability> durability) -> void
+	{
+		const std::string line(text, 'x');
+		ScratchDirectory directory(std::to_string(text));
+		std::unique_ptr<IRC::Journal> journal;
+		if (durability)
+			journal = std::make_unique<IRC::Journal>(IRC::JournalOptions{ .directory = directory.path, .durability = *durability });
+
+		size_t kept = 0;
+		const auto start = Clock::now();
+		for (uint64_t sequence = 1; sequence <= messages; sequence++)
+		{
+			auto relayed = IRC::MakeSharedMessage(IRC::Encode(Schema::ServerMessage{ .senderID = 1, .sequence = sequence, .text = line }));
+			if (journal)
+				journal->Append(sequence, *relayed);
+			kept += relayed->size();
+		}
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		volatile size_t sink = kept;
+		(void)sink;
+
+		const std::string parameters = std::string("journal=") + (durability ? DurabilityName(*durability) : "off") + " text=" + std::to_string(text);
+		ReportResult({ "journal.relay", parameters, messages / seconds, "messages/s" });
+		if (journal)
+		{
+			const auto stats = journal->GetStats();
+			ReportResult({ "journal.relay.bytes", parameters, static_cast<double>(stats.bytes) / messages, "bytes/message" });
+			ReportResult({ "journal.relay.syncs", parameters, static_cast<double>(stats.syncs), "syncs" });
+		}
+	}
+
+	// Scanning the whole journal through its zero-copy views, then single lookups by sequence number
+	// and by timestamp, each reading one record.
+	auto MeasureReads(size_t text, size_t messages, size_t lookups) -> void
+	{
+		const std::string line(text, 'x');
+		ScratchDirectory directory("read");
+		IRC::Journal journal(IRC::JournalOptions{ .directory = directory.path, .durability = IRC::JournalDurability::os });
+		for (uint64_t sequence = 1; sequence <= messages; sequence++)
+			journal.Append(sequence, *IRC::MakeSharedMessage(IRC::Encode(Schema::ServerMessage{ .senderID = 1, .sequence = sequence, .text = line })));
+
+		size_t frameBytes = 0;
+		int64_t firstTimestamp = 0;
+		int64_t lastTimestamp = 0;
+		auto start = Clock::now();
+		const size_t scanned = journal.ReadFrom(1, messages, [&](const IRC::Journal::Record& record)
+			{
+				if (!firstTimestamp)
+					firstTimestamp = record.timestamp;
+				lastTimestamp = record.timestamp;
+				frameBytes += record.frame.size() + record.frame[0];
+			});
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		const std::string parameters = "text=" + std::to_string(text) + " records=" + std::to_string(messages);
+		ReportResult({ "journal.scan", parameters, scanned / seconds, "records/s" });
+
+		std::mt19937_64 random(7);
+		uint64_t found = 0;
+		start = Clock::now();
+		for (size_t i = 0; i < lookups; i++)
+			found += journal.ReadFrom(1 + random() % messages, 1, [&](const IRC::Journal::Record& record) { found += record.sequence; });
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		ReportResult({ "journal.lookup.sequence", parameters, seconds * 1e9 / lookups, "ns/lookup" });
+
+		const int64_t span = std::max<int64_t>(lastTimestamp - firstTimestamp, 1);
+		start = Clock::now();
+		for (size_t i = 0; i < lookups; i++)
+			found += journal.ReadFromTime(firstTimestamp + static_cast<int64_t>(random() % span), 1, [&](const IRC::Journal::Record& record) { found += record.sequence; });
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		ReportResult({ "journal.lookup.time", parameters, seconds * 1e9 / lookups, "ns/lookup" });
+
+		volatile uint64_t sink = found + frameBytes;
+		(void)sink;
+	}
+}
+
+// Arguments: [messages=200000] [lookups=100000]
+auto RunJournalBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t messages = ArgumentOr(args, 0, 200000);
+	const size_t lookups = ArgumentOr(args, 1, 100000);
+
+	for (size_t text : { size_t(64), size_t(512), size_t(4096) })
+	{
+		MeasureRelay(text, messages, std::nullopt);
+		for (auto durability : { IRC::JournalDurability::os, IRC::JournalDurability::interval, IRC::JournalDurability::immediate })
+			MeasureRelay(text, messages, durability);
+	}
+
+	MeasureReads(100, messages, lookups);
+}
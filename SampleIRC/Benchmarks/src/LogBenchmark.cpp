@@ -0,0 +1,82 @@
+#include "Benchmarks.h"
+
+#include <Framework/Log.h>
+
+#include <cstdio>
+
+namespace
+{
+#if defined(_WIN32)
+	constexpr const char* nullDevice = "NUL";
+#else
+	constexpr const char* nullDevice = "/dev/null";
+#endif
+
+	enum class Sink
+	{
+		disabled,
+		async,
+		synchronous
+	};
+
+	// Nanoseconds per call as seen by the calling threads, for the kind of line the server logs per message.
+	auto MeasureLogging(size_t threadCount, size_t callsPerThread, Sink sink, FILE* file) -> double
+	{
+		IRC::Log::SetLevel(sink == Sink::disabled ? IRC::LogLevel::info : IRC::LogLevel::trace);
+
+		std::atomic<bool> go = false;
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&go, callsPerThread, sink, file]()
+				{
+					while (!go) std::this_thread::yield();
+
+					for (size_t i = 0; i < callsPerThread; i++)
+					{
+						if (sink == Sink::synchronous)
+							fprintf(file, "[Server] <%zu>: Message All\n", i);
+						else
+							IRC::Log::Trace("[Server] <{}>: Message All", i);
+					}
+				});
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		go = true;
+		for (auto& thread : threads)
+			thread.join();
+		const double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		IRC::Log::Flush();
+		return nanoseconds / callsPerThread;
+	}
+}
+
+// Arguments: [callsPerThread=200000]
+auto RunLogBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t calls = ArgumentOr(args, 0, 200000);
+
+	FILE* file = fopen(nullDevice, "w");
+	if (!file)
+		return;
+
+	const IRC::LogLevel previousLevel = IRC::Log::Level();
+	IRC::Log::SetOutput(file);
+
+	for (size_t threads : { 1, 4 })
+	{
+		const std::string parameters = "threads=" + std::to_string(threads);
+
+		ReportResult({ "log.disabled", parameters, MeasureLogging(threads, calls, Sink::disabled, file), "ns/call" });
+		ReportResult({ "log.async", parameters, MeasureLogging(threads, calls, Sink::async, file), "ns/call" });
+		ReportResult({ "log.fprintf", parameters, MeasureLogging(threads, calls, Sink::synchronous, file), "ns/call" });
+	}
+
+	IRC::Log::SetOutput(stderr);
+	IRC::Log::SetLevel(previousLevel);
+	fclose(file);
+
+	ReportResult({ "log.dropped", "", static_cast<double>(IRC::Log::DroppedRecords()), "records" });
+}
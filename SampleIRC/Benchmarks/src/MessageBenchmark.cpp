@@ -0,0 +1,191 @@
+#include "Benchmarks.h"
+
+#include <Framework/Message.h>
+#include <Framework/MessageTypes.h>
+#include <Framework/MessageSchemas.h>
+#include <Framework/MPSCQueue.h>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Receive-side lifetime of a message: framed out of a read buffer, handed over, dropped.
+	auto MeasureFraming(size_t payload, size_t iterations) -> void
+	{
+		std::vector<uint8_t> readBuffer(payload, 'x');
+		std::vector<IRC::Message<IRCMessageType>> handedOver;
+		handedOver.reserve(64);
+
+		auto frame = [&]()
+			{
+				IRC::Message<IRCMessageType> msg;
+				msg.header.id = IRCMessageType::MessageAll;
+				msg.header.size = static_cast<uint32_t>(payload);
+				msg.body.assign(readBuffer.data(), readBuffer.data() + payload);
+				handedOver.push_back(std::move(msg));
+				if (handedOver.size() == handedOver.capacity())
+					handedOver.clear();
+			};
+
+		for (size_t i = 0; i < 1000; i++)
+			frame();
+
+		const auto before = IRC::BodyPool::Stats();
+		const auto start = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			frame();
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const auto after = IRC::BodyPool::Stats();
+
+		const std::string parameters = "payload=" + std::to_string(payload);
+		ReportResult({ "message.framing", parameters, seconds * 1e9 / iterations, "ns/message" });
+		ReportResult({ "message.framing.allocations", parameters,
+					   static_cast<double>(after.heapAllocations - before.heapAllocations) / iterations, "allocations/message" });
+	}
+
+	// The server's pattern: bodies framed on one thread (a shard's I/O thread) and dropped on another
+	// (Update or a handler worker). At most `window` messages are in flight, fewer than a size class
+	// keeps, so every block can find its way back to the framing thread's cache.
+	auto MeasureCrossThread(size_t payload, size_t iterations) -> void
+	{
+		constexpr size_t window = 32;
+		std::vector<uint8_t> readBuffer(payload, 'x');
+		IRC::MPSCQueue<IRC::Message<IRCMessageType>> handedOver;
+		std::atomic<size_t> inFlight = 0;
+
+		auto frame = [&]()
+			{
+				while (inFlight.load(std::memory_order_acquire) >= window)
+					std::this_thread::yield();
+
+				IRC::Message<IRCMessageType> msg;
+				msg.header.id = IRCMessageType::MessageAll;
+				msg.header.size = static_cast<uint32_t>(payload);
+				msg.body.assign(readBuffer.data(), readBuffer.data() + payload);
+				inFlight.fetch_add(1, std::memory_order_relaxed);
+				handedOver.push_back(std::move(msg));
+			};
+
+		const size_t warmup = 1000;
+		std::thread consumer([&]()
+			{
+				std::vector<IRC::Message<IRCMessageType>> batch;
+				for (size_t dropped = 0; dropped < warmup + iterations; )
+				{
+					batch.clear();
+					const size_t count = handedOver.drain(batch, window);
+					if (count == 0)
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					batch.clear();
+					inFlight.fetch_sub(count, std::memory_order_release);
+					dropped += count;
+				}
+			});
+
+		IRC::MessageBodyStats before;
+		Clock::time_point start;
+		std::thread producer([&]()
+			{
+				for (size_t i = 0; i < warmup; i++)
+					frame();
+
+				before = IRC::BodyPool::Stats();
+				start = Clock::now();
+				for (size_t i = 0; i < iterations; i++)
+					frame();
+			});
+
+		producer.join();
+		consumer.join();
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const auto after = IRC::BodyPool::Stats();
+
+		const std::string parameters = "payload=" + std::to_string(payload);
+		ReportResult({ "message.crossThread", parameters, seconds * 1e9 / iterations, "ns/message" });
+		ReportResult({ "message.crossThread.allocations", parameters,
+					   static_cast<double>(after.heapAllocations - before.heapAllocations) / iterations, "allocations/message" });
+	}
+
+	struct ChatLine
+	{
+		char text[64];
+	};
+
+	auto MeasureStreamOperators(size_t iterations) -> void
+	{
+		const auto before = IRC::BodyPool::Stats();
+		const auto start = Clock::now();
+
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			IRC::Message<IRCMessageType> msg;
+			msg.header.id = IRCMessageType::MessageAll;
+
+			ChatLine line{};
+			msg << line << static_cast<uint64_t>(i) << static_cast<uint32_t>(i);
+
+			uint32_t sender;
+			uint64_t sequence;
+			msg >> sender >> sequence >> line;
+			checksum += sender + sequence;
+		}
+
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const auto after = IRC::BodyPool::Stats();
+
+		volatile uint64_t sink = checksum;
+		(void)sink;
+
+		const std::string parameters = "fields=3";
+		ReportResult({ "message.operators", parameters, seconds * 1e9 / iterations, "ns/message" });
+		ReportResult({ "message.operators.allocations", parameters,
+					   static_cast<double>(after.heapAllocations - before.heapAllocations) / iterations, "allocations/message" });
+	}
+
+	auto MeasureSchema(size_t iterations) -> void
+	{
+		const std::string text(100, 'x');
+
+		const auto before = IRC::BodyPool::Stats();
+		const auto start = Clock::now();
+
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			auto msg = IRC::Encode(Schema::ServerMessage{ .senderID = static_cast<uint32_t>(i), .sequence = i, .text = text });
+
+			if (auto decoded = IRC::Decode<Schema::ServerMessage>(msg))
+				checksum += decoded->senderID + decoded->text.size();
+		}
+
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const auto after = IRC::BodyPool::Stats();
+
+		volatile uint64_t sink = checksum;
+		(void)sink;
+
+		const std::string parameters = "schema=ServerMessage text=100";
+		ReportResult({ "message.schema", parameters, seconds * 1e9 / iterations, "ns/message" });
+		ReportResult({ "message.schema.allocations", parameters,
+					   static_cast<double>(after.heapAllocations - before.heapAllocations) / iterations, "allocations/message" });
+	}
+}
+
+// Arguments: [iterations=1000000]
+auto RunMessageBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t iterations = ArgumentOr(args, 0, 1000000);
+
+	for (size_t payload : { 32, 100, 512, 4096, 32768 })
+		MeasureFraming(payload, iterations);
+
+	for (size_t payload : { 512, 4096, 32768 })
+		MeasureCrossThread(payload, iterations);
+
+	MeasureStreamOperators(iterations);
+	MeasureSchema(iterations);
+}
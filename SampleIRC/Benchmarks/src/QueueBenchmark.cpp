@@ -0,0 +1,91 @@
+#include "Benchmarks.h"
+
+#include <Framework/ThreadSafeQueue.h>
+#include <Framework/MPSCQueue.h>
+#include <Framework/Message.h>
+#include <Framework/MessageTypes.h>
+
+namespace
+{
+	using Item = IRC::IdentifyingMessage<IRCMessageType>;
+
+	enum class Consumer
+	{
+		popFront,
+		drain
+	};
+
+	template<typename Queue>
+	auto MeasureQueue(size_t producers, size_t itemsPerProducer, Consumer consumer) -> double
+	{
+		Queue queue;
+		std::atomic<bool> go = false;
+		std::vector<std::thread> threads;
+
+		for (size_t p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&queue, &go, itemsPerProducer]()
+				{
+					while (!go) std::this_thread::yield();
+
+					Item item;
+					item.msg.header.id = IRCMessageType::MessageAll;
+					for (size_t i = 0; i < itemsPerProducer; i++)
+						queue.push_back(item);
+				});
+		}
+
+		const size_t total = producers * itemsPerProducer;
+		size_t consumed = 0;
+		std::vector<Item> batch;
+
+		const auto start = std::chrono::steady_clock::now();
+		go = true;
+
+		// Same shape as IServer::Update: poll for work, take it off one at a time or in batches.
+		while (consumed < total)
+		{
+			if (consumer == Consumer::drain)
+			{
+				consumed += queue.drain(batch, 256);
+				batch.clear();
+			}
+			else if (!queue.empty())
+			{
+				queue.pop_front();
+				consumed++;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (auto& thread : threads)
+			thread.join();
+
+		return total / seconds;
+	}
+}
+
+// Arguments: [itemsPerProducer=200000]
+auto RunQueueBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t items = ArgumentOr(args, 0, 200000);
+
+	for (size_t producers : { 1, 4, 16 })
+	{
+		const std::string parameters = "producers=" + std::to_string(producers);
+		const size_t perProducer = items / producers;
+
+		ReportResult({ "queue.threadsafe.pop", parameters,
+					   MeasureQueue<IRC::ThreadSafeQueue<Item>>(producers, perProducer, Consumer::popFront), "items/s" });
+		ReportResult({ "queue.threadsafe.drain", parameters,
+					   MeasureQueue<IRC::ThreadSafeQueue<Item>>(producers, perProducer, Consumer::drain), "items/s" });
+		ReportResult({ "queue.mpsc.pop", parameters,
+					   MeasureQueue<IRC::MPSCQueue<Item>>(producers, perProducer, Consumer::popFront), "items/s" });
+		ReportResult({ "queue.mpsc.drain", parameters,
+					   MeasureQueue<IRC::MPSCQueue<Item>>(producers, perProducer, Consumer::drain), "items/s" });
+	}
+}
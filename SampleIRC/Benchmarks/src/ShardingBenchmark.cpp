@@ -0,0 +1,267 @@
+#include "Benchmarks.h"
+
+#include <Framework/Server.h>
+#include <Framework/MessageTypes.h>
+
+#include <array>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+	class ShardBenchServer : public IRC::IServer<IRCMessageType>
+	{
+	public:
+		ShardBenchServer(uint16_t port, uint32_t shards) : IRC::IServer<IRCMessageType>(port, shards) { }
+		~ShardBenchServer() override { Stop(); }
+
+		std::atomic<size_t> accepted = 0;
+
+	protected:
+		bool OnClientConnect(std::shared_ptr<IRC::Connection<IRCMessageType>>) override
+		{
+			accepted++;
+			return true;
+		}
+	};
+
+	// Plain sockets that only count the bytes the server pushes to them.
+	class SinkClients
+	{
+	public:
+		SinkClients(size_t threadCount)
+			: workGuard(boost::asio::make_work_guard(context))
+		{
+			for (size_t i = 0; i < threadCount; i++)
+				threads.emplace_back([this]() { context.run(); });
+		}
+
+		~SinkClients()
+		{
+			context.stop();
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		// Stops at the first connection that fails, typically for running out of descriptors.
+		auto Connect(uint16_t port, size_t count) -> bool
+		{
+			const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port);
+			for (size_t i = 0; i < count; i++)
+			{
+				auto sink = std::make_shared<Sink>(context);
+				boost::system::error_code ec;
+				sink->socket.connect(endpoint, ec);
+				if (ec)
+				{
+					fprintf(stderr, "connect failed after %zu of %zu clients: %s\n", i, count, ec.message().c_str());
+					return false;
+				}
+				sinks.push_back(sink);
+				Read(sink);
+			}
+			return true;
+		}
+
+		std::atomic<size_t> bytesReceived = 0;
+
+	private:
+		struct Sink
+		{
+			Sink(boost::asio::io_context& context) : socket(context) { }
+
+			boost::asio::ip::tcp::socket socket;
+			std::array<uint8_t, 16 * 1024> buffer;
+		};
+
+		auto Read(std::shared_ptr<Sink> sink) -> void
+		{
+			sink->socket.async_read_some(boost::asio::buffer(sink->buffer),
+				[this, sink](std::error_code ec, std::size_t length)
+				{
+					if (!ec)
+					{
+						bytesReceived += length;
+						Read(sink);
+					}
+				});
+		}
+
+		boost::asio::io_context context;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard;
+		std::vector<std::thread> threads;
+		std::vector<std::shared_ptr<Sink>> sinks;
+	};
+
+	template<typename Predicate>
+	auto WaitUntil(Predicate predicate, std::chrono::seconds timeout) -> bool
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!predicate())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		return true;
+	}
+
+	auto SecondsSince(std::chrono::steady_clock::time_point start) -> double
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Every client takes two descriptors here, its own and the server's end, which quickly passes the
+	// usual soft limit of 1024; raise it as far as the hard limit allows.
+	auto RaiseDescriptorLimit() -> void
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		rlimit limit{};
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+		{
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+#endif
+	}
+
+	// Broadcasts to `clients` connections, with enough of them to make up about `deliveries` in all.
+	// Broadcasts are held back while too many are in flight for the connections' out-queues, which
+	// would start dropping. fanout.call is the time spent in MessageAllClients, which only posts to
+	// each shard; the shards' walk over their connections and the writes show in the other two.
+	auto RunFanout(uint16_t port, uint32_t shards, size_t clients, size_t deliveries, size_t payload) -> void
+	{
+		const std::string parameters = "clients=" + std::to_string(clients) +
+									   " shards=" + std::to_string(shards) +
+									   " payload=" + std::to_string(payload);
+
+		ShardBenchServer server(port, shards);
+		server.Start();
+
+		SinkClients sinks(std::max<size_t>(std::thread::hardware_concurrency() / 2, 1));
+		if (!sinks.Connect(port, clients))
+			return;
+		if (!WaitUntil([&]() { return server.accepted == clients; }, std::chrono::seconds(30)))
+		{
+			fprintf(stderr, "fanout: only %zu of %zu clients accepted\n", server.accepted.load(), clients);
+			return;
+		}
+
+		IRC::Message<IRCMessageType> msg;
+		msg.header.id = IRCMessageType::ServerMessage;
+		msg.body.resize(payload);
+		msg.header.size = static_cast<uint32_t>(msg.size());
+		const auto shared = IRC::MakeSharedMessage(msg);
+
+		const size_t frameBytes = sizeof(IRC::Header<IRCMessageType>) + payload;
+		const size_t broadcasts = std::max<size_t>(deliveries / clients, 1);
+		const size_t window = std::clamp<size_t>(1024 * 1024 / frameBytes, 1, 1024);
+
+		std::chrono::steady_clock::duration inCall = {};
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < broadcasts; i++)
+		{
+			if (i >= window && !WaitUntil([&]() { return sinks.bytesReceived >= (i - window) * clients * frameBytes; }, std::chrono::seconds(30)))
+			{
+				fprintf(stderr, "fanout: stalled after %zu of %zu bytes\n", sinks.bytesReceived.load(), (i - window) * clients * frameBytes);
+				return;
+			}
+
+			const auto call = std::chrono::steady_clock::now();
+			server.MessageAllClients(shared);
+			inCall += std::chrono::steady_clock::now() - call;
+		}
+
+		const size_t expectedBytes = clients * broadcasts * frameBytes;
+		if (!WaitUntil([&]() { return sinks.bytesReceived >= expectedBytes; }, std::chrono::seconds(120)))
+		{
+			fprintf(stderr, "fanout: received %zu of %zu bytes\n", sinks.bytesReceived.load(), expectedBytes);
+			return;
+		}
+		const double seconds = SecondsSince(start);
+
+		ReportResult({ "fanout.call", parameters, std::chrono::duration<double, std::nano>(inCall).count() / broadcasts, "ns/broadcast" });
+		ReportResult({ "fanout.broadcast", parameters, seconds * 1e9 / broadcasts, "ns/broadcast" });
+		ReportResult({ "fanout.delivery", parameters, clients * broadcasts / seconds, "deliveries/s" });
+	}
+
+	auto RunShardCount(uint32_t shards, size_t clients, size_t broadcasts, size_t payload) -> void
+	{
+		const uint16_t port = static_cast<uint16_t>(61000 + shards);
+		const std::string parameters = "shards=" + std::to_string(shards) +
+									   " clients=" + std::to_string(clients) +
+									   " payload=" + std::to_string(payload);
+
+		ShardBenchServer server(port, shards);
+		server.Start();
+
+		SinkClients sinks(std::max<size_t>(std::thread::hardware_concurrency() / 2, 1));
+
+		auto start = std::chrono::steady_clock::now();
+		if (!sinks.Connect(port, clients))
+			return;
+		if (!WaitUntil([&]() { return server.accepted == clients; }, std::chrono::seconds(30)))
+		{
+			fprintf(stderr, "sharding: only %zu of %zu clients accepted\n", server.accepted.load(), clients);
+			return;
+		}
+		ReportResult({ "sharding.accept", parameters, clients / SecondsSince(start), "connections/s" });
+
+		IRC::Message<IRCMessageType> msg;
+		msg.header.id = IRCMessageType::ServerMessage;
+		msg.body.resize(payload);
+		msg.header.size = static_cast<uint32_t>(msg.size());
+
+		const size_t expectedBytes = clients * broadcasts * (sizeof(IRC::Header<IRCMessageType>) + payload);
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < broadcasts; i++)
+			server.MessageAllClients(msg);
+
+		if (!WaitUntil([&]() { return sinks.bytesReceived >= expectedBytes; }, std::chrono::seconds(120)))
+		{
+			fprintf(stderr, "sharding: received %zu of %zu bytes\n", sinks.bytesReceived.load(), expectedBytes);
+			return;
+		}
+		ReportResult({ "sharding.broadcast", parameters, clients * broadcasts / SecondsSince(start), "deliveries/s" });
+	}
+}
+
+// Arguments: [clients=1000] [broadcasts=200] [payload=64] [maxShards=hardware threads]
+auto RunShardingBenchmark(const std::vector<std::string>& args) -> void
+{
+	RaiseDescriptorLimit();
+
+	const size_t clients = ArgumentOr(args, 0, 1000);
+	const size_t broadcasts = ArgumentOr(args, 1, 200);
+	const size_t payload = ArgumentOr(args, 2, 64);
+	const uint32_t maxShards = static_cast<uint32_t>(ArgumentOr(args, 3, std::max(std::thread::hardware_concurrency(), 1u)));
+
+	for (uint32_t shards = 1; shards <= maxShards; shards *= 2)
+	{
+		RunShardCount(shards, clients, broadcasts, payload);
+
+		if (shards < maxShards && shards * 2 > maxShards)
+			RunShardCount(maxShards, clients, broadcasts, payload);
+	}
+}
+
+// Arguments: [deliveries=2000000] [payload=64] [shards=hardware threads] [maxClients=10000]
+auto RunFanoutBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t deliveries = ArgumentOr(args, 0, 2000000);
+	const size_t payload = ArgumentOr(args, 1, 64);
+	const uint32_t shards = static_cast<uint32_t>(ArgumentOr(args, 2, std::max(std::thread::hardware_concurrency(), 1u)));
+	const size_t maxClients = ArgumentOr(args, 3, 10000);
+
+	RaiseDescriptorLimit();
+
+	uint16_t port = 62000;
+	for (size_t clients : { size_t(10), size_t(1000), size_t(10000) })
+	{
+		if (clients <= maxClients)
+			RunFanout(port++, shards, clients, deliveries, payload);
+	}
+}
@@ -0,0 +1,65 @@
+#include "Benchmarks.h"
+
+#include <Framework/TimerWheel.h>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Every entry comes due once per interval and is put straight back, the way the server's
+	// heartbeat check treats a connection that keeps talking. Deadlines are spread over the interval
+	// so each tick fires about connections / interval entries.
+	auto MeasureHeartbeats(size_t connections, uint64_t intervalTicks, uint64_t ticks) -> void
+	{
+		IRC::TimerWheel<uint32_t> wheel;
+		for (size_t index = 0; index < connections; index++)
+			wheel.Schedule(1 + index % intervalTicks, static_cast<uint32_t>(index));
+
+		uint64_t fired = 0;
+		const auto start = Clock::now();
+		for (uint64_t tick = 1; tick <= ticks; tick++)
+		{
+			wheel.Advance(tick, [&](uint32_t id)
+				{
+					fired++;
+					wheel.Schedule(wheel.Now() + intervalTicks, id);
+				});
+		}
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		const std::string parameters = "connections=" + std::to_string(connections) + " interval=" + std::to_string(intervalTicks);
+		ReportResult({ "timers.tick", parameters, seconds * 1e9 / ticks, "ns/tick" });
+		ReportResult({ "timers.expiry", parameters, fired ? seconds * 1e9 / fired : 0.0, "ns/expiry" });
+	}
+
+	// A tick with nothing due, with the connections all scheduled far out: the fixed cost per tick.
+	auto MeasureIdleTicks(size_t connections, uint64_t ticks) -> void
+	{
+		IRC::TimerWheel<uint32_t> wheel;
+		for (size_t index = 0; index < connections; index++)
+			wheel.Schedule(IRC::TimerWheel<uint32_t>::maxDelay, static_cast<uint32_t>(index));
+
+		size_t fired = 0;
+		const auto start = Clock::now();
+		wheel.Advance(ticks, [&](uint32_t) { fired++; });
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		volatile size_t sink = fired;
+		(void)sink;
+
+		ReportResult({ "timers.idle", "connections=" + std::to_string(connections), seconds * 1e9 / ticks, "ns/tick" });
+	}
+}
+
+// Arguments: [ticks=10000]
+auto RunTimerWheelBenchmark(const std::vector<std::string>& args) -> void
+{
+	const uint64_t ticks = ArgumentOr(args, 0, 10000);
+
+	// 8 ticks per heartbeat interval, as the server uses.
+	for (size_t connections : { size_t(10000), size_t(100000), size_t(1000000) })
+	{
+		MeasureHeartbeats(connections, 8, ticks);
+		MeasureIdleTicks(connections, ticks * 100);
+	}
+}
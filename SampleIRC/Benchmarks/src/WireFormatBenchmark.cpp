@@ -0,0 +1,63 @@
+#include "Benchmarks.h"
+
+#include <Framework/Message.h>
+#include <Framework/MessageTypes.h>
+#include <Framework/MessageSchemas.h>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto ReportFraming(const std::string& name, const IRC::Message<IRCMessageType>& msg) -> void
+	{
+		const auto encoded = IRC::MakeSharedMessage(msg);
+		const size_t body = msg.body.size();
+		const size_t v1 = encoded->size();
+		const size_t compact = encoded->compact()->size();
+
+		const std::string parameters = name + " body=" + std::to_string(body);
+		ReportResult({ "wire.bytes.v1", parameters, static_cast<double>(v1), "bytes" });
+		ReportResult({ "wire.bytes.compact", parameters, static_cast<double>(compact), "bytes" });
+		ReportResult({ "wire.overhead.v1", parameters, body ? 100.0 * (v1 - body) / body : 0.0, "%" });
+		ReportResult({ "wire.overhead.compact", parameters, body ? 100.0 * (compact - body) / body : 0.0, "%" });
+	}
+
+	auto MeasureHeaderCoding(size_t iterations) -> void
+	{
+		uint8_t buffer[IRC::CompactHeader::maxSize];
+		uint64_t checksum = 0;
+
+		const auto start = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+		{
+			IRC::Header<IRCMessageType> header{ IRCMessageType::ServerMessage, static_cast<uint32_t>(i & 0xFFFF) };
+			const size_t written = IRC::CompactHeader::Write(header, buffer);
+
+			IRC::Header<IRCMessageType> parsed;
+			checksum += IRC::CompactHeader::Read(buffer, written, parsed) + parsed.size;
+		}
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		volatile uint64_t sink = checksum;
+		(void)sink;
+
+		ReportResult({ "wire.compact.header", "write+read", seconds * 1e9 / iterations, "ns/header" });
+	}
+}
+
+// Arguments: [iterations=10000000]
+auto RunWireFormatBenchmark(const std::vector<std::string>& args) -> void
+{
+	const size_t iterations = ArgumentOr(args, 0, 10000000);
+	const std::string line(64, 'x');
+	const std::string history(4096, 'x');
+
+	ReportFraming("ServerDeny", IRC::Encode(Schema::ServerDeny{}));
+	ReportFraming("ServerAccept", IRC::Encode(Schema::ServerAccept{ .clientID = 1, .capabilities = 0 }));
+	ReportFraming("ServerPing", IRC::Encode(Schema::ServerPing{ .timestamp = 1, .scheduled = 1 }));
+	ReportFraming("ServerMessage", IRC::Encode(Schema::ServerMessage{ .senderID = 1, .sequence = 1, .text = line }));
+	ReportFraming("ChannelMessage", IRC::Encode(Schema::ChannelMessage{ .senderID = 1, .sequence = 1, .channel = "#general", .text = line }));
+	ReportFraming("ServerMessage", IRC::Encode(Schema::ServerMessage{ .senderID = 1, .sequence = 1, .text = history }));
+
+	MeasureHeaderCoding(iterations);
+}
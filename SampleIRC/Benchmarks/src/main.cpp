@@ -0,0 +1,122 @@
+#include "Benchmarks.h"
+
+#include <Framework/Log.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+
+auto ReportResult(const BenchmarkResult& result) -> void
+{
+	printf("%s,%s,%.3f,%s\n", result.benchmark.c_str(), result.parameters.c_str(), result.value, result.unit.c_str());
+	fflush(stdout);
+}
+
+auto ArgumentOr(const std::vector<std::string>& args, size_t index, size_t fallback) -> size_t
+{
+	if (index < args.size())
+		return static_cast<size_t>(std::strtoull(args[index].c_str(), nullptr, 10));
+	return fallback;
+}
+
+namespace
+{
+	// Results of one run by "benchmark,parameters", in the order they were reported.
+	auto ReadResults(const char* path, std::vector<std::pair<std::string, BenchmarkResult>>& results) -> bool
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			fprintf(stderr, "Cannot open %s\n", path);
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			// Parameters never hold a comma, so the four fields split on the first two and the last.
+			const size_t name = line.find(',');
+			const size_t parameters = name == std::string::npos ? name : line.find(',', name + 1);
+			const size_t unit = line.rfind(',');
+			if (parameters == std::string::npos || unit <= parameters || line.starts_with("benchmark,"))
+				continue;
+
+			BenchmarkResult result{ line.substr(0, name), line.substr(name + 1, parameters - name - 1),
+									std::strtod(line.c_str() + parameters + 1, nullptr), line.substr(unit + 1) };
+			results.emplace_back(line.substr(0, parameters), std::move(result));
+		}
+		return true;
+	}
+
+	// Lines up two runs' results and prints the change of every result both have, as CSV.
+	auto CompareResults(const char* beforePath, const char* afterPath) -> int
+	{
+		std::vector<std::pair<std::string, BenchmarkResult>> before;
+		std::vector<std::pair<std::string, BenchmarkResult>> after;
+		if (!ReadResults(beforePath, before) || !ReadResults(afterPath, after))
+			return 1;
+
+		std::map<std::string, double> baseline;
+		for (auto& [key, result] : before)
+			baseline.emplace(key, result.value);
+
+		printf("benchmark,parameters,before,after,change_percent,unit\n");
+		for (auto& [key, result] : after)
+		{
+			auto itr = baseline.find(key);
+			if (itr == baseline.end())
+				continue;
+
+			const double change = itr->second != 0.0 ? 100.0 * (result.value - itr->second) / itr->second : 0.0;
+			printf("%s,%s,%.3f,%.3f,%+.1f,%s\n", result.benchmark.c_str(), result.parameters.c_str(),
+				   itr->second, result.value, change, result.unit.c_str());
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 4 && std::string(argv[1]) == "compare")
+		return CompareResults(argv[2], argv[3]);
+
+	const std::map<std::string, std::function<void(const std::vector<std::string>&)>> benchmarks =
+	{
+		{ "sharding", RunShardingBenchmark },
+		{ "queue", RunQueueBenchmark },
+		{ "message", RunMessageBenchmark },
+		{ "channels", RunChannelBenchmark },
+		{ "log", RunLogBenchmark },
+		{ "compression", RunCompressionBenchmark },
+		{ "wire", RunWireFormatBenchmark },
+		{ "timers", RunTimerWheelBenchmark },
+		{ "journal", RunJournalBenchmark },
+		{ "connection", RunConnectionBenchmark },
+		{ "fanout", RunFanoutBenchmark },
+	};
+
+	if (argc < 2 || !benchmarks.contains(argv[1]))
+	{
+		printf("Usage: Benchmarks <name> [arguments...] > results.csv\n"
+			   "       Benchmarks compare <before.csv> <after.csv>\nAvailable:");
+		for (auto& [name, benchmark] : benchmarks)
+			printf(" %s", name.c_str());
+		printf("\n");
+		return 1;
+	}
+
+	// Keep stdout for the CSV; anything the framework logs goes to stderr.
+	IRC::Log::SetOutput(stderr);
+
+	std::vector<std::string> args(argv + 2, argv + argc);
+
+	printf("benchmark,parameters,value,unit\n");
+	benchmarks.at(argv[1])(args);
+
+	return 0;
+}
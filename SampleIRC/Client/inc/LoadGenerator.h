@@ -0,0 +1,168 @@
+#pragma once
+
+#include <Framework/Connection.h>
+#include <Framework/Metrics.h>
+#include <Framework/MessageTypes.h>
+
+#include <random>
+
+enum class LoadWorkload
+{
+	ping,		// ServerPing, echoed back to the sender only
+	broadcast,	// MessageAll, relayed to every connected client
+	channel,	// ChannelMessage to a channel shared with channelSize - 1 other clients
+	share		// the payload as a stream of ChannelData chunks of chunkBytes, to the same channels
+};
+
+struct PayloadDistribution
+{
+	enum class Shape
+	{
+		fixed,
+		uniform,
+		exponential
+	};
+
+	// Text payloads carry the send times in their first timestampBytes, followed by the sender's node
+	// (the index of the port it connected to), so they are never shorter than prefixBytes.
+	static constexpr size_t timestampBytes = 2 * sizeof(int64_t);
+	static constexpr size_t prefixBytes = timestampBytes + 1;
+
+	Shape shape = Shape::fixed;
+	size_t minBytes = 64;
+	size_t maxBytes = 64;	// uniform: upper bound; exponential: cap, with the mean at (min + max) / 2
+};
+
+struct LoadGeneratorOptions
+{
+	// Clients are spread round-robin over the ports, each of which may be a different server of one
+	// linked network.
+	std::string host = "127.0.0.1";
+	std::vector<uint16_t> ports = { 60000 };
+
+	size_t clients = 1000;
+	size_t threads = 2;
+	double rampPerSecond = 1000.0;		// new connections per second
+	double durationSeconds = 30.0;		// measured once the ramp has finished
+
+	LoadWorkload workload = LoadWorkload::ping;
+	size_t channelSize = 10;
+	PayloadDistribution payload;
+
+	// Open loop sends on a fixed schedule whether or not replies come back; closed loop keeps
+	// `window` messages in flight per client and sends the next one when a reply arrives.
+	bool openLoop = true;
+	double messagesPerSecond = 10.0;	// per client, open loop only
+	size_t window = 1;
+
+	// Bodies at least this large are sent compressed, if the server offers it; 0 turns it off.
+	size_t compressionThreshold = 0;
+	bool compactFraming = false;		// switch to compact framing if the server offers it
+
+	size_t chunkBytes = 16 * 1024;		// share workload: largest data chunk per frame
+};
+
+struct LoadReport
+{
+	size_t connected = 0;
+	size_t failed = 0;			// closed before the server accepted them
+	size_t dropped = 0;			// closed after being accepted
+	uint64_t sent = 0;
+	uint64_t replies = 0;		// the sender's own message coming back
+	uint64_t delivered = 0;		// every message received, including other clients' relays
+	uint64_t bytesSent = 0;
+	uint64_t bytesReceived = 0;
+	double seconds = 0.0;
+
+	// Round trip of the sender's own messages, in nanoseconds. responseTime starts the clock when
+	// a message was due on the open-loop schedule, which corrects for coordinated omission: a stall
+	// in the generator or the server is charged to every message it held back, not just the first.
+	// serviceTime starts when the message actually went out; closed loop has no schedule, so there
+	// the two are the same.
+	IRC::Histogram::Summary responseTime;
+	IRC::Histogram::Summary serviceTime;
+
+	// Broadcast workload: other clients' messages, from when they went out until they were read,
+	// split by whether the sender is on the receiver's server or on another one it is linked to.
+	IRC::Histogram::Summary sameNodeDelivery;
+	IRC::Histogram::Summary otherNodeDelivery;
+};
+
+// Multiplexes many client connections over a small pool of io_contexts, one thread each.
+// Every worker owns its clients outright: connections, message handling and the send
+// schedule are only touched from the worker's thread. Messages are handled as they are
+// framed, through the connections' message callbacks.
+class IRCLoadGenerator
+{
+public:
+	explicit IRCLoadGenerator(LoadGeneratorOptions options);
+
+	auto Run() -> LoadReport;
+
+private:
+	struct LoadClient
+	{
+		std::shared_ptr<IRC::Connection<IRCMessageType>> connection;
+		size_t index = 0;
+		uint8_t node = 0;
+		std::string channel;
+		uint32_t serverID = 0;
+		bool accepted = false;
+		size_t outstanding = 0;
+		std::chrono::steady_clock::time_point nextSend = {};
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+	};
+
+	struct Worker
+	{
+		Worker() : workGuard(boost::asio::make_work_guard(context)) { }
+
+		// Declared so the clients' sockets go before the context, and the context before the queue.
+		// The queue stays empty since every connection has a message callback; it is only there
+		// because a connection needs one to be constructed.
+		IRC::InboundQueue<IRCMessageType> inQueue;
+		boost::asio::io_context context;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard;
+		std::vector<std::unique_ptr<LoadClient>> clients;
+		std::mt19937_64 random;
+		std::string scratch;
+		std::thread thread;
+
+		IRC::Histogram responseTime;
+		IRC::Histogram serviceTime;
+		IRC::Histogram sameNodeDelivery;
+		IRC::Histogram otherNodeDelivery;
+
+		std::atomic<size_t> connected = 0;
+		std::atomic<size_t> failed = 0;
+		std::atomic<size_t> dropped = 0;
+		std::atomic<uint64_t> sent = 0;
+		std::atomic<uint64_t> replies = 0;
+		std::atomic<uint64_t> delivered = 0;
+		std::atomic<uint64_t> bytesSent = 0;
+		std::atomic<uint64_t> bytesReceived = 0;
+	};
+
+	auto RunWorker(Worker& worker) -> void;
+	auto AddClient(Worker& worker, size_t index) -> void;
+	auto HandleIncoming(Worker& worker, IRC::IdentifyingMessage<IRCMessageType>& incoming) -> void;
+	auto PumpSends(Worker& worker, std::chrono::steady_clock::time_point now) -> void;
+	auto SendOne(Worker& worker, LoadClient& client, std::chrono::steady_clock::time_point scheduled) -> void;
+	auto SendStream(LoadClient& client, std::string& payload, const int64_t(&times)[2]) -> void;
+	auto RecordReply(Worker& worker, LoadClient& client, int64_t sent, int64_t scheduled, std::chrono::steady_clock::time_point received) -> void;
+	auto RecordDelivery(Worker& worker, LoadClient& client, std::string_view text, std::chrono::steady_clock::time_point received) -> void;
+	auto CountWireBytes(Worker& worker, LoadClient& client) -> void;
+	auto PayloadSize(Worker& worker) -> size_t;
+	auto Collect() const -> LoadReport;
+
+	LoadGeneratorOptions options;
+	std::vector<boost::asio::ip::tcp::resolver::results_type> endpoints;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::string filler;
+	std::chrono::nanoseconds sendInterval;
+	std::atomic<bool> running = false;
+	std::atomic<bool> recording = false;
+};
+
+auto PrintLoadReport(const LoadReport& report) -> void;
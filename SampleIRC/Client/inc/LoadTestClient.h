@@ -2,6 +2,7 @@
 
 #include <Framework/Client.h>
 #include <Framework/MessageTypes.h>
+#include <Framework/Metrics.h>
 
 #include <chrono>
 #include <fstream>
@@ -12,9 +13,11 @@ class IRCLoadClient : public IRC::IClient<IRCMessageType>
 		IRCLoadClient(bool& stopFlag, bool logFlag)
 			: stopFlag(stopFlag),
 			logFlag(logFlag),
-			clientID(0)
+			clientID(0),
+			resendTimer(asioContext)
 		{
 			instanceCounter++;
+			SetMessageHandler([this](IRC::IdentifyingMessage<IRCMessageType>& incoming) { HandleIncoming(incoming.msg); });
 		}
 
 		IRCLoadClient(const IRCLoadClient& other) = default;
@@ -27,28 +30,34 @@ class IRCLoadClient : public IRC::IClient<IRCMessageType>
 
 		~IRCLoadClient()
 		{
+			// Stops the I/O thread first, since the message handler and the resend timer use this object.
+			Disconnect();
+
 			if (logFlag)
 			{
+				WriteLatencySummary();
 				logFile.close();
 			}
 		}
 
 	private:
-		auto CheckIncoming() -> void;
+		auto HandleIncoming(IRC::Message<IRCMessageType>& msg) -> void;
 		auto PrepareLogFile() -> bool;
 		auto SendDummyMessage() -> void;
-		auto AppendLog() -> void;
+		auto RecordLatency() -> void;
+		auto WriteLatencySummary() -> void;
 		auto ProcessServerMessage(IRC::Message<IRCMessageType>& msg) -> void;
 
 		bool& stopFlag;
 		bool logFlag;
-		bool received = false;
 		uint32_t clientID;
+		boost::asio::steady_timer resendTimer;
 
 		std::ofstream logFile;
 
-		std::chrono::system_clock::time_point sendingTimepoint = {};
-		std::chrono::system_clock::time_point receivingTimepoint = {};
+		std::chrono::steady_clock::time_point sendingTimepoint = {};
+		std::chrono::steady_clock::time_point receivingTimepoint = {};
+		std::unique_ptr<IRC::Histogram> latency = std::make_unique<IRC::Histogram>();
 
 		static int instanceCounter;
 		int messageCounter = 0;
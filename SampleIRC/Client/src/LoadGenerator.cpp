@@ -0,0 +1,445 @@
+#include "LoadGenerator.h"
+
+#include <Framework/MessageSchemas.h>
+#include <Framework/Log.h>
+
+#include <cstdio>
+#include <cstring>
+
+IRCLoadGenerator::IRCLoadGenerator(LoadGeneratorOptions options)
+	: options(std::move(options))
+{
+	auto& settings = this->options;
+	settings.threads = std::max<size_t>(settings.threads, 1);
+	settings.channelSize = std::max<size_t>(settings.channelSize, 1);
+	settings.window = std::max<size_t>(settings.window, 1);
+	if (settings.ports.empty())
+		settings.ports.push_back(60000);
+	settings.payload.minBytes = std::max(settings.payload.minBytes, PayloadDistribution::prefixBytes);
+	settings.payload.maxBytes = std::max(settings.payload.maxBytes, settings.payload.minBytes);
+	settings.chunkBytes = std::max(settings.chunkBytes, PayloadDistribution::timestampBytes);
+
+	filler.assign(settings.payload.maxBytes, 'x');
+	sendInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::duration<double>(1.0 / std::max(settings.messagesPerSecond, 1e-6)));
+}
+
+auto IRCLoadGenerator::Run() -> LoadReport
+{
+	boost::asio::io_context resolverContext;
+	boost::asio::ip::tcp::resolver resolver(resolverContext);
+	for (uint16_t port : options.ports)
+		endpoints.push_back(resolver.resolve(options.host, std::to_string(port)));
+
+	running = true;
+	for (size_t index = 0; index < options.threads; index++)
+	{
+		workers.push_back(std::make_unique<Worker>());
+		workers.back()->random.seed(index + 1);
+	}
+	for (auto& worker : workers)
+	{
+		Worker* pWorker = worker.get();
+		worker->thread = std::thread([this, pWorker]() { RunWorker(*pWorker); });
+	}
+
+	// Connections are spread round-robin over the workers at the configured rate.
+	const auto rampStart = std::chrono::steady_clock::now();
+	for (size_t index = 0; index < options.clients; index++)
+	{
+		Worker* pWorker = workers[index % workers.size()].get();
+		boost::asio::post(pWorker->context, [this, pWorker, index]() { AddClient(*pWorker, index); });
+
+		if (options.rampPerSecond > 0.0)
+			std::this_thread::sleep_until(rampStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>((index + 1) / options.rampPerSecond)));
+	}
+
+	recording = true;
+	const LoadReport atRampEnd = Collect();
+	const auto measureStart = std::chrono::steady_clock::now();
+	const auto measureEnd = measureStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(options.durationSeconds));
+	IRC::Log::Info("[Load] Ramp done: {} connected, {} failed", atRampEnd.connected, atRampEnd.failed);
+
+	LoadReport previous = atRampEnd;
+	while (std::chrono::steady_clock::now() < measureEnd)
+	{
+		std::this_thread::sleep_until(std::min(measureEnd, std::chrono::steady_clock::now() + std::chrono::seconds(1)));
+
+		const LoadReport current = Collect();
+		IRC::Log::Info("[Load] {} connected, {} sent, {} replies, {} delivered",
+					   current.connected, current.sent - previous.sent, current.replies - previous.replies, current.delivered - previous.delivered);
+		previous = current;
+	}
+
+	recording = false;
+	const LoadReport atEnd = Collect();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+
+	running = false;
+	for (auto& worker : workers)
+	{
+		if (worker->thread.joinable())
+			worker->thread.join();
+	}
+	workers.clear();
+
+	LoadReport report = atEnd;
+	report.sent -= atRampEnd.sent;
+	report.replies -= atRampEnd.replies;
+	report.delivered -= atRampEnd.delivered;
+	report.bytesSent -= atRampEnd.bytesSent;
+	report.bytesReceived -= atRampEnd.bytesReceived;
+	report.seconds = seconds;
+	return report;
+}
+
+auto IRCLoadGenerator::RunWorker(Worker& worker) -> void
+{
+	while (running.load(std::memory_order_relaxed))
+	{
+		worker.context.run_for(std::chrono::milliseconds(1));
+		PumpSends(worker, std::chrono::steady_clock::now());
+	}
+
+	for (auto& client : worker.clients)
+		client->connection->Disconnect();
+	worker.context.poll();
+}
+
+auto IRCLoadGenerator::AddClient(Worker& worker, size_t index) -> void
+{
+	auto client = std::make_unique<LoadClient>();
+	client->index = index;
+	client->node = static_cast<uint8_t>(index % endpoints.size());
+	client->channel = "#load-" + std::to_string(index / options.channelSize);
+	client->connection = std::make_shared<IRC::Connection<IRCMessageType>>(IRC::Connection<IRCMessageType>::Owner::client,
+																		   worker.context,
+																		   boost::asio::ip::tcp::socket(worker.context),
+																		   worker.inQueue);
+
+	// On the client side the connection ID is free, so it holds the worker-local slot replies are routed by.
+	client->connection->SetID(static_cast<uint32_t>(worker.clients.size()));
+	client->connection->SetOnMessage([this, &worker](IRC::IdentifyingMessage<IRCMessageType>& incoming) { HandleIncoming(worker, incoming); });
+	client->connection->SetOnClose([&worker, pClient = client.get()](std::shared_ptr<IRC::Connection<IRCMessageType>>)
+		{
+			if (pClient->accepted)
+				worker.dropped.fetch_add(1, std::memory_order_relaxed);
+			else
+				worker.failed.fetch_add(1, std::memory_order_relaxed);
+			pClient->accepted = false;
+		});
+
+	client->connection->ConnectToServer(endpoints[client->node]);
+	worker.clients.push_back(std::move(client));
+}
+
+auto IRCLoadGenerator::HandleIncoming(Worker& worker, IRC::IdentifyingMessage<IRCMessageType>& incoming) -> void
+{
+	LoadClient& client = *worker.clients[incoming.remote->GetID()];
+	IRC::Message<IRCMessageType>& msg = incoming.msg;
+	CountWireBytes(worker, client);
+
+	auto onReply = [this, &worker, &client, &incoming](std::string_view text)
+		{
+			int64_t times[2];
+			std::memcpy(times, text.data(), sizeof(times));
+			RecordReply(worker, client, times[0], times[1], incoming.queuedAt);
+		};
+
+	switch (msg.header.id)
+	{
+	case IRCMessageType::ServerAccept:
+		if (auto accept = IRC::Decode<Schema::ServerAccept>(msg))
+		{
+			client.serverID = accept->clientID;
+			client.accepted = true;
+			worker.connected.fetch_add(1, std::memory_order_relaxed);
+
+			uint32_t wanted = 0;
+			if (options.compressionThreshold > 0)
+				wanted |= IRC::Capability::compression;
+			if (options.compactFraming)
+				wanted |= IRC::Capability::compactFraming;
+
+			if (const uint32_t agreed = wanted & accept->capabilities)
+			{
+				client.connection->Send(IRC::Encode(Schema::ClientHello{ .capabilities = agreed }));
+				if (agreed & IRC::Capability::compression)
+					client.connection->EnableCompression(options.compressionThreshold);
+				if (agreed & IRC::Capability::compactFraming)
+					client.connection->UpgradeFraming();
+			}
+
+			if (options.workload == LoadWorkload::channel || options.workload == LoadWorkload::share)
+				client.connection->Send(IRC::Encode(Schema::JoinChannel{ .channel = client.channel }));
+
+			// A random phase keeps clients that connected together from sending in lockstep.
+			std::uniform_int_distribution<int64_t> phase(0, sendInterval.count());
+			client.nextSend = std::chrono::steady_clock::now() + std::chrono::nanoseconds(phase(worker.random));
+		}
+		break;
+
+	case IRCMessageType::ServerPing:
+		worker.delivered.fetch_add(1, std::memory_order_relaxed);
+		if (auto ping = IRC::Decode<Schema::ServerPing>(msg))
+			RecordReply(worker, client, ping->timestamp, ping->scheduled, incoming.queuedAt);
+		break;
+
+	// Client IDs are only unique per server, so the sender's node tells its own messages apart.
+	case IRCMessageType::ServerMessage:
+		worker.delivered.fetch_add(1, std::memory_order_relaxed);
+		if (auto relayed = IRC::Decode<Schema::ServerMessage>(msg); relayed && relayed->text.size() >= PayloadDistribution::prefixBytes)
+		{
+			if (relayed->senderID == client.serverID && static_cast<uint8_t>(relayed->text[PayloadDistribution::timestampBytes]) == client.node)
+				onReply(relayed->text);
+			else
+				RecordDelivery(worker, client, relayed->text, incoming.queuedAt);
+		}
+		break;
+
+	case IRCMessageType::ChannelMessage:
+		worker.delivered.fetch_add(1, std::memory_order_relaxed);
+		if (auto relayed = IRC::Decode<Schema::ChannelMessage>(msg); relayed && relayed->senderID == client.serverID)
+			onReply(relayed->text);
+		break;
+
+	// A shared payload is complete, and its times readable, once its last chunk is back.
+	case IRCMessageType::ChannelData:
+		worker.delivered.fetch_add(1, std::memory_order_relaxed);
+		if (auto relayed = IRC::Decode<Schema::ChannelData>(msg); relayed && relayed->senderID == client.serverID && IRC::IsEndOfStream(msg.header))
+			onReply(relayed->data);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Timestamps come back in the sender's own payload; the reply time is when the frame was read.
+auto IRCLoadGenerator::RecordReply(Worker& worker, LoadClient& client, int64_t sent, int64_t scheduled, std::chrono::steady_clock::time_point received) -> void
+{
+	worker.replies.fetch_add(1, std::memory_order_relaxed);
+	if (client.outstanding > 0)
+		client.outstanding--;
+
+	if (recording.load(std::memory_order_relaxed))
+	{
+		const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(received.time_since_epoch()).count();
+		worker.responseTime.Record(static_cast<uint64_t>(std::max<int64_t>(0, now - scheduled)));
+		worker.serviceTime.Record(static_cast<uint64_t>(std::max<int64_t>(0, now - sent)));
+	}
+
+	// Closed loop refills the window straight from the reply rather than on the next pump.
+	if (!options.openLoop && client.accepted && running.load(std::memory_order_relaxed))
+	{
+		while (client.outstanding < options.window)
+			SendOne(worker, client, received);
+	}
+}
+
+// The send time and node come from the sender's payload; steady_clock is shared by every process on
+// the machine, so this holds across servers as long as they all run on the generator's host.
+auto IRCLoadGenerator::RecordDelivery(Worker& worker, LoadClient& client, std::string_view text, std::chrono::steady_clock::time_point received) -> void
+{
+	if (!recording.load(std::memory_order_relaxed))
+		return;
+
+	int64_t sent;
+	std::memcpy(&sent, text.data(), sizeof(sent));
+	const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(received.time_since_epoch()).count();
+	const bool sameNode = static_cast<uint8_t>(text[PayloadDistribution::timestampBytes]) == client.node;
+	(sameNode ? worker.sameNodeDelivery : worker.otherNodeDelivery).Record(static_cast<uint64_t>(std::max<int64_t>(0, now - sent)));
+}
+
+auto IRCLoadGenerator::PumpSends(Worker& worker, std::chrono::steady_clock::time_point now) -> void
+{
+	// Caps how far one pass catches up a client that has fallen behind its schedule.
+	constexpr size_t maxBurst = 64;
+
+	for (auto& client : worker.clients)
+	{
+		if (!client->accepted)
+			continue;
+
+		size_t burst = 0;
+		if (options.openLoop)
+		{
+			while (client->nextSend <= now && burst++ < maxBurst)
+			{
+				SendOne(worker, *client, client->nextSend);
+				client->nextSend += sendInterval;
+			}
+		}
+		else
+		{
+			while (client->outstanding < options.window && burst++ < maxBurst)
+				SendOne(worker, *client, now);
+		}
+	}
+}
+
+auto IRCLoadGenerator::SendOne(Worker& worker, LoadClient& client, std::chrono::steady_clock::time_point scheduled) -> void
+{
+	const int64_t times[2] =
+	{
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(),
+		std::chrono::duration_cast<std::chrono::nanoseconds>(scheduled.time_since_epoch()).count()
+	};
+
+	worker.scratch.assign(filler, 0, PayloadSize(worker));
+	std::memcpy(worker.scratch.data(), times, sizeof(times));
+	worker.scratch[PayloadDistribution::timestampBytes] = static_cast<char>(client.node);
+	const std::string_view text = worker.scratch;
+
+	if (options.workload == LoadWorkload::share)
+	{
+		SendStream(client, worker.scratch, times);
+		client.outstanding++;
+		worker.sent.fetch_add(1, std::memory_order_relaxed);
+		CountWireBytes(worker, client);
+		return;
+	}
+
+	IRC::Message<IRCMessageType> msg;
+	switch (options.workload)
+	{
+	case LoadWorkload::ping:
+		msg = IRC::Encode(Schema::ServerPing{ .timestamp = times[0], .scheduled = times[1] });
+		break;
+
+	case LoadWorkload::broadcast:
+		msg = IRC::Encode(Schema::MessageAll{ .text = text });
+		break;
+
+	case LoadWorkload::channel:
+		msg = IRC::Encode(Schema::ChannelMessage{ .senderID = 0, .sequence = 0, .channel = client.channel, .text = text });
+		break;
+
+	default:
+		break;
+	}
+
+	client.connection->Send(msg);
+	client.outstanding++;
+	worker.sent.fetch_add(1, std::memory_order_relaxed);
+	CountWireBytes(worker, client);
+}
+
+// Any short remainder goes in the first chunk, so the last one is always full and can carry the
+// times, which are what the reply is read from.
+auto IRCLoadGenerator::SendStream(LoadClient& client, std::string& payload, const int64_t(&times)[2]) -> void
+{
+	const std::string_view data = payload;
+	const size_t chunk = std::min(options.chunkBytes, data.size());
+	const size_t lastOffset = data.size() - chunk;
+	std::memcpy(payload.data() + lastOffset, times, sizeof(times));
+
+	size_t length = data.size() % chunk ? data.size() % chunk : chunk;
+	for (size_t offset = 0; offset < data.size(); offset += length, length = chunk)
+	{
+		auto msg = IRC::Encode(Schema::ChannelData{ .senderID = 0, .channel = client.channel, .data = data.substr(offset, length) });
+		IRC::MarkStreamChunk(msg, offset == lastOffset);
+		client.connection->Send(msg);
+	}
+}
+
+// Taken from the connection's socket counters, so compressed traffic counts at its size on the wire.
+// Writes complete later on this same thread, so sent bytes trail by at most the writes in flight.
+auto IRCLoadGenerator::CountWireBytes(Worker& worker, LoadClient& client) -> void
+{
+	const uint64_t read = client.connection->GetReadStats().bytesRead;
+	const uint64_t written = client.connection->GetWriteStats().bytesWritten;
+	worker.bytesReceived.fetch_add(read - client.bytesRead, std::memory_order_relaxed);
+	worker.bytesSent.fetch_add(written - client.bytesWritten, std::memory_order_relaxed);
+	client.bytesRead = read;
+	client.bytesWritten = written;
+}
+
+auto IRCLoadGenerator::PayloadSize(Worker& worker) -> size_t
+{
+	const PayloadDistribution& payload = options.payload;
+
+	switch (payload.shape)
+	{
+	case PayloadDistribution::Shape::uniform:
+		return std::uniform_int_distribution<size_t>(payload.minBytes, payload.maxBytes)(worker.random);
+
+	case PayloadDistribution::Shape::exponential:
+	{
+		const double mean = (payload.maxBytes - payload.minBytes) / 2.0;
+		if (mean <= 0.0)
+			return payload.minBytes;
+
+		const double extra = std::exponential_distribution<double>(1.0 / mean)(worker.random);
+		return std::min(payload.maxBytes, payload.minBytes + static_cast<size_t>(extra));
+	}
+
+	default:
+		return payload.minBytes;
+	}
+}
+
+auto IRCLoadGenerator::Collect() const -> LoadReport
+{
+	LoadReport report;
+	for (auto& worker : workers)
+	{
+		report.connected += worker->connected.load(std::memory_order_relaxed);
+		report.failed += worker->failed.load(std::memory_order_relaxed);
+		report.dropped += worker->dropped.load(std::memory_order_relaxed);
+		report.sent += worker->sent.load(std::memory_order_relaxed);
+		report.replies += worker->replies.load(std::memory_order_relaxed);
+		report.delivered += worker->delivered.load(std::memory_order_relaxed);
+		report.bytesSent += worker->bytesSent.load(std::memory_order_relaxed);
+		report.bytesReceived += worker->bytesReceived.load(std::memory_order_relaxed);
+	}
+
+	// Each worker records into its own histograms; they are only combined here.
+	auto responseTime = std::make_unique<IRC::Histogram>();
+	auto serviceTime = std::make_unique<IRC::Histogram>();
+	auto sameNodeDelivery = std::make_unique<IRC::Histogram>();
+	auto otherNodeDelivery = std::make_unique<IRC::Histogram>();
+	for (auto& worker : workers)
+	{
+		responseTime->Merge(worker->responseTime);
+		serviceTime->Merge(worker->serviceTime);
+		sameNodeDelivery->Merge(worker->sameNodeDelivery);
+		otherNodeDelivery->Merge(worker->otherNodeDelivery);
+	}
+	report.responseTime = responseTime->Summarize();
+	report.serviceTime = serviceTime->Summarize();
+	report.sameNodeDelivery = sameNodeDelivery->Summarize();
+	report.otherNodeDelivery = otherNodeDelivery->Summarize();
+	return report;
+}
+
+auto PrintLoadReport(const LoadReport& report) -> void
+{
+	const double seconds = std::max(report.seconds, 1e-9);
+
+	printf("connected       %zu\n", report.connected);
+	printf("failed          %zu\n", report.failed);
+	printf("dropped         %zu\n", report.dropped);
+	printf("seconds         %.3f\n", report.seconds);
+	printf("sent            %llu (%.1f/s)\n", static_cast<unsigned long long>(report.sent), report.sent / seconds);
+	printf("replies         %llu (%.1f/s)\n", static_cast<unsigned long long>(report.replies), report.replies / seconds);
+	printf("delivered       %llu (%.1f/s)\n", static_cast<unsigned long long>(report.delivered), report.delivered / seconds);
+	printf("bytes sent      %llu (%.1f MB/s)\n", static_cast<unsigned long long>(report.bytesSent), report.bytesSent / seconds / 1e6);
+	printf("bytes received  %llu (%.1f MB/s)\n", static_cast<unsigned long long>(report.bytesReceived), report.bytesReceived / seconds / 1e6);
+
+	auto printLatency = [](const char* name, const IRC::Histogram::Summary& summary)
+		{
+			printf("%s  p50 %.1fus  p99 %.1fus  p99.9 %.1fus  max %.1fus  (%llu samples)\n", name,
+				   summary.p50 / 1e3, summary.p99 / 1e3, summary.p999 / 1e3, summary.max / 1e3,
+				   static_cast<unsigned long long>(summary.count));
+		};
+
+	printLatency("response time ", report.responseTime);
+	printLatency("service time  ", report.serviceTime);
+	if (report.sameNodeDelivery.count > 0)
+		printLatency("same node     ", report.sameNodeDelivery);
+	if (report.otherNodeDelivery.count > 0)
+		printLatency("other node    ", report.otherNodeDelivery);
+}
@@ -1,82 +1,87 @@
 #include "LoadTestClient.h"
 
-#include <iostream>
+#include <Framework/MessageSchemas.h>
+#include <Framework/Log.h>
+
 #include <thread>
 
 int IRCLoadClient::instanceCounter = 0;
 
 auto IRCLoadClient::PingServer() -> void
 {
-	IRC::Message<IRCMessageType> msg;
-	msg.header.id = IRCMessageType::ServerPing;
-
-	std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
+	const int64_t timeNow = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 
-	msg << timeNow;
-	Send(msg);
+	Send(IRC::Encode(Schema::ServerPing{ .timestamp = timeNow, .scheduled = timeNow }));
 }
 
 auto IRCLoadClient::MessageAll() -> void
 {
-	IRC::Message<IRCMessageType> msg;
-	msg.header.id = IRCMessageType::MessageAll;
-	Send(msg);
+	Send(IRC::Encode(Schema::MessageAll{}));
 }
 
 static auto ProcessPing(IRC::Message<IRCMessageType>& msg) -> void
 {
-	std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
-	std::chrono::system_clock::time_point timeThen;
-	msg >> timeThen;
-	std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() * 1000.0 << "ms \n";
+	auto ping = IRC::Decode<Schema::ServerPing>(msg);
+	if (!ping)
+		return;
+
+	std::chrono::steady_clock::time_point timeNow = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point timeThen(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ping->timestamp)));
+	IRC::Log::Info("Ping: {}ms", std::chrono::duration<double>(timeNow - timeThen).count() * 1000.0);
 }
 
 auto IRCLoadClient::ProcessServerMessage(IRC::Message<IRCMessageType>& msg) -> void
 {
-	uint32_t clientID;
-	msg >> clientID;
-	if (clientID == this->clientID)
+	auto relayed = IRC::Decode<Schema::ServerMessage>(msg);
+	if (relayed && relayed->senderID == clientID)
 	{
-		receivingTimepoint = std::chrono::system_clock::now();
-		received = true;
-		std::cout << "Received back from server\n";
+		receivingTimepoint = std::chrono::steady_clock::now();
+		IRC::Log::Trace("Received back from server");
+
+		if (logFlag && !stopFlag)
+		{
+			RecordLatency();
+			resendTimer.expires_after(std::chrono::milliseconds(50));
+			resendTimer.async_wait([this](const boost::system::error_code& ec)
+				{
+					if (!ec && !stopFlag)
+						SendDummyMessage();
+				});
+		}
 	}
 }
 
-auto IRCLoadClient::CheckIncoming() -> void
+// Runs on the client's I/O thread as each message is framed.
+auto IRCLoadClient::HandleIncoming(IRC::Message<IRCMessageType>& msg) -> void
 {
-	if (not Incoming().empty())
+	switch (msg.header.id)
 	{
-		auto msg = Incoming().pop_front().msg;
-
-		switch (msg.header.id)
-		{
-		case IRCMessageType::ServerAccept:
-			std::cout << "Server Accepted Connection\n";
-			msg >> clientID;
-			break;
-		case IRCMessageType::ServerDeny:
-			std::cout << "Server denied connection\n";
-			break;
-
-		case IRCMessageType::ServerPing:
-			std::cout << "Server ping\n";
-			ProcessPing(msg);
-			break;
-
-		case IRCMessageType::MessageAll:
-			ProcessServerMessage(msg);
-			std::cout << "Message all\n";
-			break;
-
-		case IRCMessageType::ServerMessage:
-			ProcessServerMessage(msg);
-			std::cout << "Server message\n";
-			break;
-		default:
-			std::cout << "enum = " << static_cast<int>(msg.header.id) << "\n";
-			break;
-		}
+	case IRCMessageType::ServerAccept:
+		IRC::Log::Info("Server Accepted Connection");
+		if (auto accept = IRC::Decode<Schema::ServerAccept>(msg))
+			clientID = accept->clientID;
+		break;
+	case IRCMessageType::ServerDeny:
+		IRC::Log::Warning("Server denied connection");
+		break;
+
+	case IRCMessageType::ServerPing:
+		IRC::Log::Trace("Server ping");
+		ProcessPing(msg);
+		break;
+
+	case IRCMessageType::MessageAll:
+		ProcessServerMessage(msg);
+		IRC::Log::Trace("Message all");
+		break;
+
+	case IRCMessageType::ServerMessage:
+		ProcessServerMessage(msg);
+		IRC::Log::Trace("Server message");
+		break;
+	default:
+		IRC::Log::Debug("enum = {}", msg.header.id);
+		break;
 	}
 }
 
@@ -88,21 +93,24 @@ auto IRCLoadClient::PrepareLogFile() -> bool
 
 auto IRCLoadClient::SendDummyMessage() -> void
 {
-	IRC::Message<IRCMessageType> msg;
-	msg.header.id = IRCMessageType::MessageAll;
-
-	msg << "Lorem ipsum dolor sit amet, consectetur adipiscing elit.Nullam nec arcu ac diam blandit aliquam eu.";
+	auto msg = IRC::Encode(Schema::MessageAll{ .text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.Nullam nec arcu ac diam blandit aliquam eu." });
 	messageCounter++;
-	sendingTimepoint = std::chrono::system_clock::now();
+	sendingTimepoint = std::chrono::steady_clock::now();
 	Send(msg);
 }
 
-auto IRCLoadClient::AppendLog() -> void
+auto IRCLoadClient::RecordLatency() -> void
+{
+	latency->Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(receivingTimepoint - sendingTimepoint).count()));
+}
+
+// One row for the whole run instead of one per message; latencies in milliseconds.
+auto IRCLoadClient::WriteLatencySummary() -> void
 {
-	std::string line = std::format("{},{},{}\n", instanceCounter,
-											     messageCounter,
-											     std::chrono::duration<double>(receivingTimepoint - sendingTimepoint).count() * 1000.0);
-	logFile << line;
+	const IRC::Histogram::Summary summary = latency->Summarize();
+	logFile << "clients,messages,p50,p99,p999,max\n"
+			<< instanceCounter << ',' << summary.count << ','
+			<< summary.p50 / 1e6 << ',' << summary.p99 / 1e6 << ',' << summary.p999 / 1e6 << ',' << summary.max / 1e6 << '\n';
 }
 
 auto IRCLoadClient::Run() -> void
@@ -111,7 +119,7 @@ auto IRCLoadClient::Run() -> void
 	{
 		if (!PrepareLogFile())
 		{
-			std::cout << "Log file error\n";
+			IRC::Log::Error("Log file error");
 			return;
 		}
 	}
@@ -120,23 +128,14 @@ auto IRCLoadClient::Run() -> void
 		SendDummyMessage();
 	}
 
+	// Messages are handled on the I/O thread, so this thread only watches for the end of the test.
 	while (!stopFlag)
 	{
-		if (IsConnected())
-		{
-			CheckIncoming();
-			if (logFlag && received)
-			{
-				received = false;
-				AppendLog();
-				std::this_thread::sleep_for(std::chrono::milliseconds(50));
-				SendDummyMessage();
-			}
-		}
-		else
+		if (!IsConnected())
 		{
-			std::cout << "Server Down\n";
+			IRC::Log::Warning("Server Down");
 			break;
 		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 	}
 }
\ No newline at end of file
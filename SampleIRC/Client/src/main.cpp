@@ -1,10 +1,14 @@
 ﻿#include <iostream>
 #include <thread>
 #include <memory>
+#include <cstdlib>
+#include <string_view>
 
 #include "LoadTestClient.h"
+#include "LoadGenerator.h"
 
-int main()
+// The original test: one IRCLoadClient (own io_context and two threads) added per second.
+static auto RunSequentialClients() -> int
 {
 	std::vector<std::shared_ptr<IRCLoadClient>> clients;
 	std::vector<std::thread> threads;
@@ -48,5 +52,113 @@ int main()
 
 	std::cout << "Test finished\n";
 
+	return 0;
+}
+
+static auto ParsePayload(std::string_view value, PayloadDistribution& payload) -> void
+{
+	// "64", "16-1024" (uniform) or "exp:16-1024"
+	if (value.starts_with("exp:"))
+	{
+		payload.shape = PayloadDistribution::Shape::exponential;
+		value.remove_prefix(4);
+	}
+
+	const size_t dash = value.find('-');
+	payload.minBytes = std::strtoull(std::string(value.substr(0, dash)).c_str(), nullptr, 10);
+	payload.maxBytes = dash == std::string_view::npos ? payload.minBytes : std::strtoull(std::string(value.substr(dash + 1)).c_str(), nullptr, 10);
+
+	if (payload.shape == PayloadDistribution::Shape::fixed && payload.maxBytes != payload.minBytes)
+		payload.shape = PayloadDistribution::Shape::uniform;
+}
+
+// "60000" or "60000,60001,60002"
+static auto ParsePorts(std::string_view value) -> std::vector<uint16_t>
+{
+	std::vector<uint16_t> ports;
+	while (!value.empty())
+	{
+		const size_t comma = value.find(',');
+		ports.push_back(static_cast<uint16_t>(std::atoi(std::string(value.substr(0, comma)).c_str())));
+		value.remove_prefix(comma == std::string_view::npos ? value.size() : comma + 1);
+	}
+	return ports;
+}
+
+static auto PrintUsage() -> void
+{
+	std::cout << "Usage: Client [--legacy] [--host H] [--port P[,P...]] [--clients N] [--threads N] [--ramp N/s]\n"
+				 "              [--duration S] [--workload ping|broadcast|channel|share] [--channel-size N]\n"
+				 "              [--payload N | MIN-MAX | exp:MIN-MAX] [--rate N/s per client | --closed WINDOW]\n"
+				 "              [--compress MIN_BODY_BYTES] [--compact] [--chunk BYTES]\n";
+}
+
+int main(int argc, char* argv[])
+{
+	LoadGeneratorOptions options;
+
+	for (int index = 1; index < argc; index++)
+	{
+		const std::string_view flag = argv[index];
+		if (flag == "--legacy")
+			return RunSequentialClients();
+		if (flag == "--compact")
+		{
+			options.compactFraming = true;
+			continue;
+		}
+
+		if (index + 1 >= argc)
+		{
+			PrintUsage();
+			return 1;
+		}
+
+		const char* value = argv[++index];
+		if (flag == "--host")
+			options.host = value;
+		else if (flag == "--port")
+			options.ports = ParsePorts(value);
+		else if (flag == "--clients")
+			options.clients = std::strtoull(value, nullptr, 10);
+		else if (flag == "--threads")
+			options.threads = std::strtoull(value, nullptr, 10);
+		else if (flag == "--ramp")
+			options.rampPerSecond = std::atof(value);
+		else if (flag == "--duration")
+			options.durationSeconds = std::atof(value);
+		else if (flag == "--workload")
+			options.workload = std::string_view(value) == "broadcast" ? LoadWorkload::broadcast
+							 : std::string_view(value) == "channel" ? LoadWorkload::channel
+							 : std::string_view(value) == "share" ? LoadWorkload::share
+							 : LoadWorkload::ping;
+		else if (flag == "--channel-size")
+			options.channelSize = std::strtoull(value, nullptr, 10);
+		else if (flag == "--payload")
+			ParsePayload(value, options.payload);
+		else if (flag == "--rate")
+			options.messagesPerSecond = std::atof(value);
+		else if (flag == "--compress")
+			options.compressionThreshold = std::strtoull(value, nullptr, 10);
+		else if (flag == "--chunk")
+			options.chunkBytes = std::strtoull(value, nullptr, 10);
+		else if (flag == "--closed")
+		{
+			options.openLoop = false;
+			options.window = std::strtoull(value, nullptr, 10);
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	IRCLoadGenerator generator(options);
+	const LoadReport report = generator.Run();
+
+	IRC::Log::Flush();
+	PrintLoadReport(report);
+
 	return 0;
 }
\ No newline at end of file
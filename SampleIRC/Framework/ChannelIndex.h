@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Common.h"
+
+#include <span>
+#include <string_view>
+#include <unordered_map>
+
+namespace IRC
+{
+	// Two-way membership index: channel -> dense array of member slots, member -> channels it is in.
+	// Every membership is stored once on each side with the position of its twin, so joining and
+	// parting are O(1) swap-removes, and a channel's members can be walked without touching anyone else.
+	// A channel is closed when its last member leaves, and its ID is handed to the next new channel.
+	// Not thread-safe.
+	template<typename Value>
+	class ChannelIndex
+	{
+	public:
+		using ChannelID = uint32_t;
+		using MemberID = uint32_t;
+
+		struct Slot
+		{
+			MemberID member;
+			uint32_t membershipIndex;
+			Value value;
+		};
+
+		// Called as each channel closes, with the ID it had, before anything can reuse it.
+		auto SetOnChannelClosed(std::function<void(ChannelID)> handler) -> void
+		{
+			onChannelClosed = std::move(handler);
+		}
+
+		auto FindChannel(std::string_view name) const -> std::optional<ChannelID>
+		{
+			auto itr = channelsByName.find(name);
+			if (itr == channelsByName.end())
+				return std::nullopt;
+			return itr->second;
+		}
+
+		auto Join(std::string_view name, MemberID member, const Value& value) -> bool
+		{
+			const ChannelID channel = FindOrCreateChannel(name);
+			auto [itr, inserted] = positions.try_emplace(Key(member, channel), 0);
+			if (!inserted)
+				return false;
+
+			auto& memberships = membersById[member];
+			auto& slots = channels[channel].slots;
+
+			itr->second = static_cast<uint32_t>(memberships.size());
+			memberships.push_back({ channel, static_cast<uint32_t>(slots.size()) });
+			slots.push_back({ member, itr->second, value });
+			return true;
+		}
+
+		auto Part(std::string_view name, MemberID member) -> bool
+		{
+			auto channel = FindChannel(name);
+			if (!channel)
+				return false;
+
+			auto itr = positions.find(Key(member, *channel));
+			if (itr == positions.end())
+				return false;
+
+			RemoveMembership(member, itr->second);
+			return true;
+		}
+
+		// Leaves every channel; O(number of channels the member is in).
+		auto PartAll(MemberID member) -> void
+		{
+			auto itr = membersById.find(member);
+			if (itr == membersById.end())
+				return;
+
+			while (!itr->second.empty())
+				RemoveMembership(member, static_cast<uint32_t>(itr->second.size() - 1));
+
+			membersById.erase(itr);
+		}
+
+		auto Members(ChannelID channel) const -> std::span<const Slot>
+		{
+			return channels[channel].slots;
+		}
+
+		auto ChannelName(ChannelID channel) const -> std::string_view
+		{
+			return channels[channel].name;
+		}
+
+		auto ChannelCount() const -> size_t
+		{
+			return channelsByName.size();
+		}
+
+		auto ChannelsOf(MemberID member) const -> size_t
+		{
+			auto itr = membersById.find(member);
+			return itr == membersById.end() ? 0 : itr->second.size();
+		}
+
+		auto MembershipCount() const -> size_t
+		{
+			return positions.size();
+		}
+
+	private:
+		struct Channel
+		{
+			std::string name;
+			std::vector<Slot> slots;
+		};
+
+		struct Membership
+		{
+			ChannelID channel;
+			uint32_t slot;
+		};
+
+		struct NameHash
+		{
+			using is_transparent = void;
+			auto operator()(std::string_view name) const -> size_t { return std::hash<std::string_view>{}(name); }
+		};
+
+		static auto Key(MemberID member, ChannelID channel) -> uint64_t
+		{
+			return (static_cast<uint64_t>(member) << 32) | channel;
+		}
+
+		auto FindOrCreateChannel(std::string_view name) -> ChannelID
+		{
+			if (auto channel = FindChannel(name))
+				return *channel;
+
+			ChannelID channel;
+			if (!freeChannels.empty())
+			{
+				channel = freeChannels.back();
+				freeChannels.pop_back();
+				channels[channel].name = name;
+			}
+			else
+			{
+				channel = static_cast<ChannelID>(channels.size());
+				channels.push_back({ std::string(name), {} });
+			}
+			channelsByName.emplace(std::string(name), channel);
+			return channel;
+		}
+
+		auto RemoveMembership(MemberID member, uint32_t membershipIndex) -> void
+		{
+			auto& memberships = membersById[member];
+			const Membership membership = memberships[membershipIndex];
+			auto& slots = channels[membership.channel].slots;
+
+			// Swap-remove the slot from the channel and repoint the moved slot's twin.
+			if (membership.slot != slots.size() - 1)
+			{
+				slots[membership.slot] = std::move(slots.back());
+				const Slot& moved = slots[membership.slot];
+				membersById[moved.member][moved.membershipIndex].slot = membership.slot;
+			}
+			slots.pop_back();
+
+			// Same on the member side.
+			if (membershipIndex != memberships.size() - 1)
+			{
+				memberships[membershipIndex] = memberships.back();
+				const Membership& moved = memberships[membershipIndex];
+				channels[moved.channel].slots[moved.slot].membershipIndex = membershipIndex;
+				positions[Key(member, moved.channel)] = membershipIndex;
+			}
+			memberships.pop_back();
+
+			positions.erase(Key(member, membership.channel));
+			if (slots.empty())
+				CloseChannel(membership.channel);
+		}
+
+		auto CloseChannel(ChannelID channel) -> void
+		{
+			channelsByName.erase(channelsByName.find(channels[channel].name));
+			channels[channel].name.clear();
+			freeChannels.push_back(channel);
+			if (onChannelClosed)
+				onChannelClosed(channel);
+		}
+
+		std::vector<Channel> channels;
+		std::vector<ChannelID> freeChannels;
+		std::unordered_map<std::string, ChannelID, NameHash, std::equal_to<>> channelsByName;
+		std::unordered_map<MemberID, std::vector<Membership>> membersById;
+		std::unordered_map<uint64_t, uint32_t> positions;
+		std::function<void(ChannelID)> onChannelClosed;
+	};
+}
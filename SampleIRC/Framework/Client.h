@@ -2,7 +2,9 @@
 #include "Common.h"
 #include "Message.h"
 #include "ThreadSafeQueue.h"
+#include "MPSCQueue.h"
 #include "Connection.h"
+#include "Log.h"
 
 namespace IRC
 {
@@ -10,6 +12,8 @@ namespace IRC
 	class IClient
 	{
 	public:
+		using MessageHandler = std::function<void(IRC::IdentifyingMessage<T>&)>;
+
 		IClient()
 		{}
 
@@ -30,18 +34,21 @@ namespace IRC
 			{
 				auto endpoints = ResolveHost(host, port);
 
-				connection = std::make_unique<IRC::Connection<T>>(IRC::Connection<T>::Owner::client, 
+				connection = std::make_shared<IRC::Connection<T>>(IRC::Connection<T>::Owner::client, 
 																  asioContext, 
 																  boost::asio::ip::tcp::socket(asioContext), 
 																  inQueue);
 
+				if (messageHandler)
+					connection->SetOnMessage([this](IRC::IdentifyingMessage<T>& incoming) { Deliver(incoming); });
+
 				connection->ConnectToServer(endpoints);
 
 				contextThread = std::thread([this]() { asioContext.run(); });
 			}
 			catch (std::exception& e)
 			{
-				std::cerr << "Client Exception: " << e.what() << "\n";
+				IRC::Log::Error("Client Exception: {}", e.what());
 				return false;
 			}
 			return true;
@@ -58,7 +65,7 @@ namespace IRC
 			if (contextThread.joinable())
 				contextThread.join();
 
-			connection.release();
+			connection.reset();
 		}
 
 		bool IsConnected()
@@ -75,17 +82,47 @@ namespace IRC
 				connection->Send(msg);
 		}
 
-		IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>>& Incoming()
+		// Polling mode, the default: messages wait in Incoming() until the caller pops them.
+		IRC::InboundQueue<T>& Incoming()
 		{
 			return inQueue;
 		}
 
+		// Callback mode: each message goes to the handler as soon as it is framed, on the client's I/O
+		// thread, and Incoming() stays empty. Must be called before Connect.
+		auto SetMessageHandler(MessageHandler handler) -> void
+		{
+			messageHandler = std::move(handler);
+			handlerStrand.reset();
+		}
+
+		// As above, but the handler runs on `executor`. Messages still arrive one at a time and in
+		// order, even when the executor has several threads.
+		auto SetMessageHandler(MessageHandler handler, boost::asio::any_io_executor executor) -> void
+		{
+			messageHandler = std::move(handler);
+			handlerStrand.emplace(boost::asio::make_strand(std::move(executor)));
+		}
+
 	protected:
 		boost::asio::io_context asioContext;
 		std::thread contextThread;
-		std::unique_ptr<IRC::Connection<T>> connection;
+		std::shared_ptr<IRC::Connection<T>> connection;
 
 	private:
-		IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>> inQueue;
+		auto Deliver(IRC::IdentifyingMessage<T>& incoming) -> void
+		{
+			if (!handlerStrand)
+			{
+				messageHandler(incoming);
+				return;
+			}
+
+			boost::asio::post(*handlerStrand, [this, incoming = std::move(incoming)]() mutable { messageHandler(incoming); });
+		}
+
+		IRC::InboundQueue<T> inQueue;
+		MessageHandler messageHandler;
+		std::optional<boost::asio::strand<boost::asio::any_io_executor>> handlerStrand;
 	};
 }
@@ -1,16 +1,23 @@
 ﻿#pragma once
 
 #include <memory>
+#include <functional>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <deque>
 #include <optional>
 #include <vector>
+#include <array>
 #include <iostream>
 #include <algorithm>
+#include <iterator>
 #include <chrono>
 #include <cstdint>
 #include <string>
+#include <utility>
 
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0A00
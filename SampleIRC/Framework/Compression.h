@@ -0,0 +1,215 @@
+#pragma once
+
+#include "Common.h"
+
+namespace IRC
+{
+	// LZ4 block format: a greedy matcher with one hash probe per position, so a compressed body can be
+	// read by any LZ4 block decoder. Each thread keeps one hash table for all its calls; positions are
+	// stored relative to a base that moves past every input, so stale entries are recognised instead of
+	// the table being cleared per message.
+	class Lz4
+	{
+	public:
+		static constexpr auto Bound(size_t size) -> size_t
+		{
+			return size + size / 255 + 16;
+		}
+
+		// Returns the compressed size, or 0 if the result does not fit in `capacity`.
+		static auto Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity) -> size_t
+		{
+			Context& context = LocalContext();
+			if (context.base > UINT32_MAX - size - 1)
+			{
+				context.table.fill(0);
+				context.base = 1;
+			}
+			const uint32_t base = context.base;
+			context.base += static_cast<uint32_t>(size) + 1;
+
+			uint8_t* out = destination;
+			uint8_t* const outEnd = destination + capacity;
+			size_t anchor = 0;
+
+			if (size > matchFinderLimit)
+			{
+				const size_t limit = size - matchFinderLimit;
+				size_t position = 0;
+				while (position < limit)
+				{
+					const uint32_t sequence = Read32(source + position);
+					uint32_t& slot = context.table[Hash(sequence)];
+					const uint32_t candidate = slot;
+					slot = base + static_cast<uint32_t>(position);
+
+					if (candidate < base || position - (candidate - base) > maxOffset || Read32(source + (candidate - base)) != sequence)
+					{
+						// Skip faster through input that is not matching.
+						position += 1 + ((position - anchor) >> 6);
+						continue;
+					}
+
+					size_t match = candidate - base;
+					while (position > anchor && match > 0 && source[position - 1] == source[match - 1])
+					{
+						position--;
+						match--;
+					}
+
+					size_t length = minMatch;
+					while (position + length < size - lastLiterals && source[position + length] == source[match + length])
+						length++;
+
+					if (!WriteSequence(out, outEnd, source + anchor, position - anchor, position - match, length))
+						return 0;
+
+					position += length;
+					anchor = position;
+				}
+			}
+
+			if (!WriteSequence(out, outEnd, source + anchor, size - anchor, 0, 0))
+				return 0;
+			return static_cast<size_t>(out - destination);
+		}
+
+		// Decodes exactly `size` bytes into exactly `decompressedSize`; false on any malformed input.
+		static auto Decompress(const uint8_t* source, size_t size, uint8_t* destination, size_t decompressedSize) -> bool
+		{
+			const uint8_t* in = source;
+			const uint8_t* const inEnd = source + size;
+			uint8_t* out = destination;
+			uint8_t* const outEnd = destination + decompressedSize;
+
+			while (in < inEnd)
+			{
+				const uint8_t token = *in++;
+
+				size_t literals = token >> 4;
+				if (literals == 15 && !ReadLength(in, inEnd, literals))
+					return false;
+				if (literals > static_cast<size_t>(inEnd - in) || literals > static_cast<size_t>(outEnd - out))
+					return false;
+
+				if (literals > 0)
+					std::memcpy(out, in, literals);
+				in += literals;
+				out += literals;
+
+				if (in == inEnd)
+					break;
+
+				if (inEnd - in < 2)
+					return false;
+				const size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+				in += 2;
+				if (offset == 0 || offset > static_cast<size_t>(out - destination))
+					return false;
+
+				size_t length = token & 15;
+				if (length == 15 && !ReadLength(in, inEnd, length))
+					return false;
+				length += minMatch;
+				if (length > static_cast<size_t>(outEnd - out))
+					return false;
+
+				const uint8_t* match = out - offset;
+				if (offset >= length)
+				{
+					std::memcpy(out, match, length);
+					out += length;
+				}
+				else
+				{
+					// Overlapping copy repeats the last `offset` bytes.
+					for (size_t index = 0; index < length; index++)
+						*out++ = match[index];
+				}
+			}
+
+			return out == outEnd;
+		}
+
+	private:
+		static constexpr uint32_t hashBits = 12;
+		static constexpr size_t minMatch = 4;
+		static constexpr size_t lastLiterals = 5;
+		static constexpr size_t matchFinderLimit = 12;
+		static constexpr size_t maxOffset = 65535;
+
+		struct Context
+		{
+			std::array<uint32_t, size_t(1) << hashBits> table{};
+			uint32_t base = 1;
+		};
+
+		static auto LocalContext() -> Context&
+		{
+			thread_local Context context;
+			return context;
+		}
+
+		static auto Hash(uint32_t sequence) -> uint32_t
+		{
+			return (sequence * 2654435761u) >> (32 - hashBits);
+		}
+
+		static auto Read32(const uint8_t* source) -> uint32_t
+		{
+			uint32_t value;
+			std::memcpy(&value, source, sizeof(value));
+			return value;
+		}
+
+		static auto WriteLength(uint8_t*& out, size_t length) -> void
+		{
+			for (; length >= 255; length -= 255)
+				*out++ = 255;
+			*out++ = static_cast<uint8_t>(length);
+		}
+
+		static auto ReadLength(const uint8_t*& in, const uint8_t* inEnd, size_t& length) -> bool
+		{
+			uint8_t next;
+			do
+			{
+				if (in == inEnd)
+					return false;
+				next = *in++;
+				length += next;
+			} while (next == 255);
+			return true;
+		}
+
+		// A match length of 0 writes the final, literals-only sequence.
+		static auto WriteSequence(uint8_t*& out, uint8_t* outEnd, const uint8_t* literals, size_t literalCount,
+								  size_t offset, size_t matchLength) -> bool
+		{
+			const size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+			if (worstCase > static_cast<size_t>(outEnd - out))
+				return false;
+
+			uint8_t* token = out++;
+			*token = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4);
+			if (literalCount >= 15)
+				WriteLength(out, literalCount - 15);
+
+			if (literalCount > 0)
+				std::memcpy(out, literals, literalCount);
+			out += literalCount;
+
+			if (matchLength == 0)
+				return true;
+
+			*out++ = static_cast<uint8_t>(offset);
+			*out++ = static_cast<uint8_t>(offset >> 8);
+
+			const size_t length = matchLength - minMatch;
+			*token |= static_cast<uint8_t>(std::min<size_t>(length, 15));
+			if (length >= 15)
+				WriteLength(out, length - 15);
+			return true;
+		}
+	};
+}
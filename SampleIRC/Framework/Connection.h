@@ -2,11 +2,48 @@
 
 #include "Common.h"
 #include "ThreadSafeQueue.h"
+#include "MPSCQueue.h"
 #include "Message.h"
+#include "Log.h"
+#include "Metrics.h"
 
+#include <unordered_map>
 
 namespace IRC
 {
+	// Queue every connection pushes its framed messages into. Define IRC_LOCKED_INBOUND_QUEUE
+	// to go back to the mutex-based ThreadSafeQueue.
+#ifdef IRC_LOCKED_INBOUND_QUEUE
+	template<typename T>
+	using InboundQueue = IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>>;
+#else
+	template<typename T>
+	using InboundQueue = IRC::MPSCQueue<IRC::IdentifyingMessage<T>>;
+#endif
+
+	// What a connection does once its out-queue goes over the high watermark.
+	enum class SlowConsumerPolicy
+	{
+		dropOldest,		// drop queued non-control messages, oldest first, down to the low watermark
+		disconnect,		// close the connection
+		pauseProducers	// stop reading from the connections whose messages fill the queue until it drains to the low watermark
+	};
+
+	// A queue is over the high watermark when either limit is exceeded, and back under the low
+	// watermark when both are met.
+	template<typename T>
+	struct OutQueueLimits
+	{
+		size_t highWatermarkBytes = 4 * 1024 * 1024;
+		size_t lowWatermarkBytes = 1024 * 1024;
+		size_t highWatermarkMessages = 16 * 1024;
+		size_t lowWatermarkMessages = 4 * 1024;
+		SlowConsumerPolicy policy = SlowConsumerPolicy::dropOldest;
+
+		// Messages this returns true for are never dropped; without it every message may be.
+		bool (*isControl)(T id) = nullptr;
+	};
+
 	template<typename T>
 	class Connection : public std::enable_shared_from_this<Connection<T>>
 	{
@@ -20,12 +57,15 @@ namespace IRC
 		Connection(Owner parent, 
 				   boost::asio::io_context& _asioContext, 
 				   boost::asio::ip::tcp::socket _socket, 
-				   IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>>& queueIn)
-			: asioContext(_asioContext), 
-			socket(std::move(_socket)), 
+				   IRC::InboundQueue<T>& queueIn)
+			: socket(std::move(_socket)), 
+			asioContext(_asioContext), 
 			inQueue(queueIn),
 			owner(parent)
 		{
+			boost::system::error_code ec;
+			const auto remote = socket.remote_endpoint(ec);
+			local = !ec && remote.address().is_loopback();
 		}
 
 		virtual ~Connection()
@@ -41,13 +81,24 @@ namespace IRC
 			id = ID;
 		}
 
-		auto ConnectToClient(uint32_t uid = 0) -> void
+		auto GetShard() const -> uint32_t
+		{
+			return shard;
+		}
+
+		auto SetShard(uint32_t index) -> void
+		{
+			shard = index;
+		}
+
+		auto ConnectToClient() -> void
 		{
 			if (owner == Owner::server)
 			{
 				if (socket.is_open())
 				{
-					ReadHeader();
+					DisableNagle();
+					ReadIncoming();
 				}
 			}
 		}
@@ -57,11 +108,17 @@ namespace IRC
 			if (owner == Owner::client)
 			{
 				boost::asio::async_connect(socket, endpoints,
-					[this](std::error_code ec, boost::asio::ip::tcp::endpoint endpoint)
+					[this, self = this->shared_from_this()](std::error_code ec, boost::asio::ip::tcp::endpoint)
 					{
 						if (!ec)
 						{
-							ReadHeader();
+							DisableNagle();
+							ReadIncoming();
+						}
+						else
+						{
+							IRC::Log::Debug("[{}] Connect Fail: {}", id, ec.message());
+							Close();
 						}
 					});
 			}
@@ -71,7 +128,27 @@ namespace IRC
 		auto Disconnect() -> void
 		{
 			if (IsConnected())
-				boost::asio::post(asioContext, [this]() { socket.close(); });
+				boost::asio::post(asioContext, [this, self = this->shared_from_this()]() { Close(); });
+		}
+
+		// Runs once, on asioContext, when the connection closes for any reason.
+		auto SetOnClose(std::function<void(std::shared_ptr<Connection<T>>)> handler) -> void
+		{
+			onClose = std::move(handler);
+		}
+
+		// Hands each framed message to the handler, on asioContext, instead of pushing it into the
+		// inbound queue. Set it before the connection starts reading.
+		auto SetOnMessage(std::function<void(IRC::IdentifyingMessage<T>&)> handler) -> void
+		{
+			onMessage = std::move(handler);
+		}
+
+		// Whether the peer connected from this machine; fixed when the connection is made, so safe
+		// to ask from any thread.
+		auto IsLocal() const -> bool
+		{
+			return local;
 		}
 
 		auto IsConnected() const -> bool
@@ -85,134 +162,668 @@ namespace IRC
 		}
 
 		auto Send(const IRC::Message<T>& msg) -> void
+		{
+			Send(IRC::MakeSharedMessage(msg));
+		}
+
+		// `producer` is the connection the message is relayed on behalf of, if any: the one whose reads
+		// the pauseProducers policy holds back while this connection's queue is over the high watermark.
+		auto Send(const IRC::SharedMessage<T>& msg, std::shared_ptr<Connection<T>> producer = nullptr) -> void
 		{
 			boost::asio::post(asioContext,
-				[this, msg]()
+				[this, self = this->shared_from_this(), msg, producer = std::move(producer)]()
 				{
-					bool outQueueIdle = outQueue.empty();
-					outQueue.push_back(msg);
-					if (outQueueIdle)
-					{
-						WriteHeader();
-					}
+					IRC::SharedMessage<T> wire = compressOutgoing ? IRC::CompressedMessage(msg, compressionThreshold) : msg;
+					if (writeFraming == IRC::Framing::compact)
+						wire = IRC::CompactMessage(wire);
+					Enqueue(std::move(wire), producer);
 				});
 		}
 
+		// One shared, empty frame for every heartbeat, in whichever framing the connection uses.
+		auto SendHeartbeat() -> void
+		{
+			static const IRC::SharedMessage<T> heartbeat = []()
+				{
+					IRC::Message<T> msg;
+					msg.header.id = static_cast<T>(IRC::heartbeatId);
+					return IRC::MakeSharedMessage(msg);
+				}();
+			Send(heartbeat);
+		}
+
+		// True while another connection's full queue holds this one's reads back, when silence is not
+		// the peer's doing.
+		auto IsReadPaused() const -> bool
+		{
+			return readsPaused;
+		}
+
+		// Switches what this side sends to compact framing, once the peer has offered it. Messages
+		// already queued go out first, in v1, followed by the upgrade frame.
+		auto UpgradeFraming() -> void
+		{
+			boost::asio::post(asioContext,
+				[this, self = this->shared_from_this()]()
+				{
+					if (writeFraming == IRC::Framing::compact)
+						return;
+
+					IRC::Message<T> upgrade;
+					upgrade.header.id = static_cast<T>(IRC::framingUpgradeId);
+					Enqueue(IRC::MakeSharedMessage(upgrade));
+					writeFraming = IRC::Framing::compact;
+				});
+		}
+
+		// Sends bodies of at least `threshold` bytes compressed, once the peer has said it can read them.
+		// Compressed bodies are always accepted on the way in.
+		auto EnableCompression(size_t threshold) -> void
+		{
+			boost::asio::post(asioContext,
+				[this, self = this->shared_from_this(), threshold]()
+				{
+					compressOutgoing = true;
+					compressionThreshold = threshold;
+				});
+		}
+
+		// Whether the server's broadcasts go to this connection, as they do by default. Off for a
+		// connection that carries something other than a client, such as a link to another server.
+		auto SetReceivesBroadcasts(bool enabled) -> void
+		{
+			receivesBroadcasts.store(enabled, std::memory_order_relaxed);
+		}
+
+		auto ReceivesBroadcasts() const -> bool
+		{
+			return receivesBroadcasts.load(std::memory_order_relaxed);
+		}
+
+		// Shard-wide totals this connection adds its traffic to; optional.
+		auto SetTrafficCounters(IRC::TrafficCounters* counters) -> void
+		{
+			traffic = counters;
+		}
+
+		// Takes effect for messages queued afterwards; set it before the connection starts.
+		auto SetOutQueueLimits(const IRC::OutQueueLimits<T>& limits) -> void
+		{
+			outQueueLimits = limits;
+		}
+
+		struct OutQueueStats
+		{
+			uint64_t queuedMessages = 0;
+			uint64_t queuedBytes = 0;
+			uint64_t peakQueuedBytes = 0;
+			uint64_t droppedMessages = 0;
+			uint64_t droppedBytes = 0;
+			uint64_t readPauses = 0;
+		};
+
+		auto GetOutQueueStats() const -> OutQueueStats
+		{
+			return { queuedMessages.load(std::memory_order_relaxed),
+					 queuedBytes.load(std::memory_order_relaxed),
+					 peakQueuedBytes.load(std::memory_order_relaxed),
+					 droppedMessages.load(std::memory_order_relaxed),
+					 droppedBytes.load(std::memory_order_relaxed),
+					 readPauses.load(std::memory_order_relaxed) };
+		}
+
+		// Upper bound on the bytes gathered into a single write; at least one message is always sent.
+		auto SetMaxWriteBatchBytes(size_t bytes) -> void
+		{
+			maxWriteBatchBytes = bytes;
+		}
+
+		struct WriteStats
+		{
+			uint64_t writeCalls = 0;
+			uint64_t messagesWritten = 0;
+			uint64_t bytesWritten = 0;
+
+			auto MessagesPerWrite() const -> double
+			{
+				return writeCalls ? static_cast<double>(messagesWritten) / writeCalls : 0.0;
+			}
+		};
+
+		auto GetWriteStats() const -> WriteStats
+		{
+			return { writeCalls.load(std::memory_order_relaxed),
+					 messagesWritten.load(std::memory_order_relaxed),
+					 bytesWritten.load(std::memory_order_relaxed) };
+		}
+
+		// Frames whose body claims more than this are refused and the connection closed, before any of
+		// the body is buffered; so is a compressed body that would expand past it. Larger payloads have
+		// to be sent as a stream of chunks (see IRC::MarkStreamChunk), which the handler gets one by one.
+		auto SetMaxFrameSize(size_t bytes) -> void
+		{
+			maxFrameSize = bytes;
+		}
+
+		// Takes effect before the first read; frames larger than the buffer are read into the message directly.
+		auto SetReadBufferSize(size_t bytes) -> void
+		{
+			readBufferSize = std::max({ bytes, sizeof(IRC::Header<T>), IRC::CompactHeader::maxSize });
+		}
+
+		struct ReadStats
+		{
+			uint64_t readCalls = 0;
+			uint64_t messagesRead = 0;
+			uint64_t bytesRead = 0;
+
+			auto MessagesPerRead() const -> double
+			{
+				return readCalls ? static_cast<double>(messagesRead) / readCalls : 0.0;
+			}
+		};
+
+		auto GetReadStats() const -> ReadStats
+		{
+			return { readCalls.load(std::memory_order_relaxed),
+					 messagesRead.load(std::memory_order_relaxed),
+					 bytesRead.load(std::memory_order_relaxed) };
+		}
+
 	private:
-		auto WriteHeader() -> void
+		// Writes are already gathered per connection (see WriteMessages), so Nagle's algorithm would only
+		// hold the small frames of a quiet connection back until the peer's delayed ACK.
+		auto DisableNagle() -> void
+		{
+			boost::system::error_code ec;
+			socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+		}
+
+		// Runs on asioContext with the message already in this connection's wire form.
+		auto Enqueue(IRC::SharedMessage<T> wire, const std::shared_ptr<Connection<T>>& producer = nullptr) -> void
+		{
+			if (closed)
+				return;
+
+			bool outQueueIdle = outQueue.empty();
+			outQueueBytes += wire->size();
+			outQueue.push_back(std::move(wire));
+			if (outQueueIdle)
+			{
+				WriteMessages();
+			}
+			else if (AboveHighWatermark())
+			{
+				OnHighWatermark(producer);
+			}
+			PublishOutQueueDepth();
+		}
+
+		// Gathers everything queued so far (up to maxWriteBatchBytes) into one scatter/gather write.
+		// A partial write leaves writeOffset pointing into the first unfinished message.
+		auto WriteMessages() -> void
 		{
-			boost::asio::async_write(socket, boost::asio::buffer(&outQueue.front().header, sizeof(IRC::Header<T>)),
-				[this](std::error_code ec, std::size_t length)
+			writeBuffers.clear();
+
+			size_t batchBytes = 0;
+			for (size_t index = 0; index < outQueue.size() && writeBuffers.size() < maxWriteBuffers; index++)
+			{
+				const auto& msg = outQueue[index];
+				const size_t offset = index == 0 ? writeOffset : 0;
+
+				if (!writeBuffers.empty() && batchBytes + msg->size() - offset > maxWriteBatchBytes)
+					break;
+
+				writeBuffers.emplace_back(msg->data() + offset, msg->size() - offset);
+				batchBytes += msg->size() - offset;
+			}
+
+			socket.async_write_some(writeBuffers,
+				[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 				{
 					if (!ec)
 					{
-						if (outQueue.front().body.size() > 0)
+						writeCalls.fetch_add(1, std::memory_order_relaxed);
+						bytesWritten.fetch_add(length, std::memory_order_relaxed);
+						Count(&IRC::TrafficCounters::bytesOut, uint64_t(length));
+						ConsumeWritten(length);
+
+						if (!outQueue.empty())
 						{
-							WriteBody();
+							WriteMessages();
 						}
-						else
-						{
-							outQueue.pop_front();
 
-							if (!outQueue.empty())
-							{
-								WriteHeader();
-							}
-						}
+						if (!pausedProducers.empty() && BelowLowWatermark(outQueue.size()))
+							ResumeProducers();
+						PublishOutQueueDepth();
 					}
 					else
 					{
-						printf("[%d] Write Header Fail.\n", id);
-						socket.close();
+						IRC::Log::Debug("[{}] Write Messages Fail: {}", id, ec.message());
+						Close();
 					}
 				});
 		}
 
-		auto WriteBody() -> void
+		auto ConsumeWritten(size_t length) -> void
 		{
-			boost::asio::async_write(socket, boost::asio::buffer(outQueue.front().body.data(), outQueue.front().body.size()),
-				[this](std::error_code ec, std::size_t length)
+			uint64_t completed = 0;
+			while (length > 0)
+			{
+				const size_t remaining = outQueue.front()->size() - writeOffset;
+				if (length < remaining)
 				{
-					if (!ec)
+					writeOffset += length;
+					break;
+				}
+
+				length -= remaining;
+				writeOffset = 0;
+				outQueueBytes -= outQueue.front()->size();
+				outQueue.pop_front();
+				completed++;
+			}
+			messagesWritten.fetch_add(completed, std::memory_order_relaxed);
+			Count(&IRC::TrafficCounters::messagesOut, completed);
+		}
+
+		auto AboveHighWatermark() const -> bool
+		{
+			return outQueueBytes > outQueueLimits.highWatermarkBytes || outQueue.size() > outQueueLimits.highWatermarkMessages;
+		}
+
+		auto BelowLowWatermark(size_t messages) const -> bool
+		{
+			return outQueueBytes <= outQueueLimits.lowWatermarkBytes && messages <= outQueueLimits.lowWatermarkMessages;
+		}
+
+		auto OnHighWatermark(const std::shared_ptr<Connection<T>>& producer) -> void
+		{
+			switch (outQueueLimits.policy)
+			{
+			case SlowConsumerPolicy::dropOldest:
+				DropOldest();
+				break;
+
+			case SlowConsumerPolicy::disconnect:
+				IRC::Log::Warning("[{}] Slow consumer: {} bytes queued, disconnecting", id, outQueueBytes);
+				Count(&IRC::TrafficCounters::slowConsumerDisconnects, uint64_t(1));
+				Close();
+				break;
+
+			case SlowConsumerPolicy::pauseProducers:
+				// A producer keeps filling the queue with what it sent before the pause reached it, which
+				// is bounded; messages sent on nobody's behalf cannot be held back at their source, so
+				// for those the queue is capped at twice the high watermark.
+				if (producer && producer.get() != this)
+				{
+					// An entry left by a producer that is gone no longer holds anything.
+					auto [itr, inserted] = pausedProducers.try_emplace(producer.get(), producer);
+					if (inserted || itr->second.expired())
 					{
-						outQueue.pop_front();
+						itr->second = producer;
+						producer->PauseReads();
+					}
+				}
+				else if (outQueueBytes > 2 * outQueueLimits.highWatermarkBytes || outQueue.size() > 2 * outQueueLimits.highWatermarkMessages)
+				{
+					IRC::Log::Warning("[{}] Slow consumer: {} bytes queued with producers paused, disconnecting", id, outQueueBytes);
+					Count(&IRC::TrafficCounters::slowConsumerDisconnects, uint64_t(1));
+					Close();
+				}
+				break;
+			}
+		}
 
-						if (!outQueue.empty())
-						{
-							WriteHeader();
-						}
+		// The queue is never empty here, so a write is in flight and its first writeBuffers.size()
+		// entries are referenced by the socket; those and control messages are kept.
+		auto DropOldest() -> void
+		{
+			size_t messages = outQueue.size();
+			uint64_t dropped = 0;
+			uint64_t bytes = 0;
+
+			auto kept = outQueue.begin() + std::min(writeBuffers.size(), outQueue.size());
+			for (auto itr = kept; itr != outQueue.end(); itr++)
+			{
+				const IRC::Header<T> header = (*itr)->header();
+				// Dropping part of a stream would corrupt the rest of it, so chunks are kept like control messages.
+				const bool control = IRC::IsFramingUpgrade(header) || IRC::IsHeartbeat(header) || IRC::IsStreamChunk(header)
+					|| (outQueueLimits.isControl && outQueueLimits.isControl(header.id));
+				if (control || BelowLowWatermark(messages))
+				{
+					if (kept != itr)
+						*kept = std::move(*itr);
+					kept++;
+					continue;
+				}
+
+				outQueueBytes -= (*itr)->size();
+				bytes += (*itr)->size();
+				messages--;
+				dropped++;
+			}
+			outQueue.erase(kept, outQueue.end());
+
+			droppedMessages.fetch_add(dropped, std::memory_order_relaxed);
+			droppedBytes.fetch_add(bytes, std::memory_order_relaxed);
+			Count(&IRC::TrafficCounters::droppedMessages, dropped);
+		}
+
+		// The shard totals take the difference from what this connection last published.
+		auto PublishOutQueueDepth() -> void
+		{
+			if (closed)
+				return;
+
+			const auto published = [](const std::atomic<uint64_t>& gauge) { return static_cast<int64_t>(gauge.load(std::memory_order_relaxed)); };
+			Count(&IRC::TrafficCounters::outQueueMessages, static_cast<int64_t>(outQueue.size()) - published(queuedMessages));
+			Count(&IRC::TrafficCounters::outQueueBytes, static_cast<int64_t>(outQueueBytes) - published(queuedBytes));
+			queuedMessages.store(outQueue.size(), std::memory_order_relaxed);
+			queuedBytes.store(outQueueBytes, std::memory_order_relaxed);
+			if (outQueueBytes > peakQueuedBytes.load(std::memory_order_relaxed))
+				peakQueuedBytes.store(outQueueBytes, std::memory_order_relaxed);
+		}
+
+		// Reading carries on after every frame unless the out-queue paused it; the parked read is
+		// restarted once the queue drains.
+		auto ContinueReading() -> void
+		{
+			if (readsPaused)
+				readParked = true;
+			else
+				ReadIncoming();
+		}
+
+		// A connection can feed several slow consumers at once, so its reads resume only once every
+		// one of them that paused it has let it go.
+		auto PauseReads() -> void
+		{
+			boost::asio::post(asioContext, [this, self = this->shared_from_this()]()
+				{
+					if (readPauseHolds++ == 0)
+					{
+						readsPaused = true;
+						readPauses.fetch_add(1, std::memory_order_relaxed);
 					}
-					else
+				});
+		}
+
+		auto ResumeReads() -> void
+		{
+			boost::asio::post(asioContext, [this, self = this->shared_from_this()]()
+				{
+					if (readPauseHolds == 0 || --readPauseHolds > 0)
+						return;
+
+					readsPaused = false;
+					if (readParked && !closed)
 					{
-						printf("[%d] Write Body Fail.\n", id);
-						socket.close();
+						readParked = false;
+						ReadIncoming();
 					}
 				});
 		}
 
-		auto ReadHeader() -> void
+		// Once the queue has drained, or the connection is gone, every producer it held back may read again.
+		auto ResumeProducers() -> void
 		{
-			boost::asio::async_read(socket, boost::asio::buffer(&tempMsg.header, sizeof(IRC::Header<T>)),
-				[this](std::error_code ec, std::size_t length)
+			for (auto& [pointer, producer] : pausedProducers)
+			{
+				if (auto paused = producer.lock())
+					paused->ResumeReads();
+			}
+			pausedProducers.clear();
+		}
+
+		// Fills the receive buffer with whatever the socket has (one syscall) and then frames
+		// every complete message in it before reading again.
+		auto ReadIncoming() -> void
+		{
+			if (readBuffer.empty())
+				readBuffer.resize(readBufferSize);
+
+			if (readStart == readEnd)
+			{
+				readStart = readEnd = 0;
+			}
+			else if (readStart > 0)
+			{
+				std::memmove(readBuffer.data(), readBuffer.data() + readStart, readEnd - readStart);
+				readEnd -= readStart;
+				readStart = 0;
+			}
+
+			socket.async_read_some(boost::asio::buffer(readBuffer.data() + readEnd, readBuffer.size() - readEnd),
+				[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 				{
 					if (!ec)
 					{
-						if (tempMsg.header.size > 0)
-						{
-							tempMsg.body.resize(tempMsg.header.size);
-							ReadBody();
-						}
-						else
-						{
-							PushIncoming();
-						}
+						readCalls.fetch_add(1, std::memory_order_relaxed);
+						bytesRead.fetch_add(length, std::memory_order_relaxed);
+						Count(&IRC::TrafficCounters::bytesIn, uint64_t(length));
+						readEnd += length;
+						ParseIncoming();
 					}
 					else
 					{
-						printf("[%d] Read Header Fail.\n", id);
-						socket.close();
+						IRC::Log::Debug("[{}] Read Fail: {}", id, ec.message());
+						Close();
 					}
 				});
 		}
 
-		auto ReadBody() -> void
+		// The header's size in bytes, 0 if it is not all here yet, or -1 if it is malformed.
+		auto ReadHeader(IRC::Header<T>& header) -> ptrdiff_t
+		{
+			const uint8_t* in = readBuffer.data() + readStart;
+			const size_t available = readEnd - readStart;
+
+			if (readFraming == IRC::Framing::compact)
+				return IRC::CompactHeader::Read(in, available, header);
+
+			if (available < sizeof(IRC::Header<T>))
+				return 0;
+			std::memcpy(&header, in, sizeof(IRC::Header<T>));
+			return static_cast<ptrdiff_t>(sizeof(IRC::Header<T>));
+		}
+
+		auto ParseIncoming() -> void
 		{
-			boost::asio::async_read(socket, boost::asio::buffer(tempMsg.body.data(), tempMsg.body.size()),
-				[this](std::error_code ec, std::size_t length)
+			while (readEnd > readStart)
+			{
+				IRC::Header<T> header;
+				const ptrdiff_t headerRead = ReadHeader(header);
+				if (headerRead == 0)
+					break;
+				if (headerRead < 0)
+				{
+					IRC::Log::Debug("[{}] Malformed frame header", id);
+					Close();
+					return;
+				}
+
+				const size_t headerSize = static_cast<size_t>(headerRead);
+				if (readFraming == IRC::Framing::v1 && IRC::IsFramingUpgrade(header))
+				{
+					readFraming = IRC::Framing::compact;
+					readStart += headerSize;
+					continue;
+				}
+
+				const uint8_t* body = readBuffer.data() + readStart + headerSize;
+				const size_t available = readEnd - readStart - headerSize;
+				const size_t bodySize = IRC::BodySize(header);
+				if (bodySize > maxFrameSize)
+				{
+					IRC::Log::Warning("[{}] Frame of {} bytes is over the {} byte limit", id, bodySize, maxFrameSize);
+					Close();
+					return;
+				}
+
+				if (available < bodySize)
+				{
+					// A body too large for the receive buffer is finished by reading straight into
+					// the message; a smaller one just waits for the next read to complete it.
+					if (headerSize + bodySize > readBuffer.size())
+					{
+						tempMsg.header = header;
+						tempMsg.body.resize(bodySize);
+						std::memcpy(tempMsg.body.data(), body, available);
+						readStart = readEnd = 0;
+						ReadBodyRemainder(available);
+						return;
+					}
+					break;
+				}
+
+				IRC::Message<T> msg;
+				msg.header = header;
+				msg.body.assign(body, body + bodySize);
+				readStart += headerSize + bodySize;
+				PushIncoming(std::move(msg));
+				if (closed)
+					return;
+			}
+
+			ContinueReading();
+		}
+
+		auto ReadBodyRemainder(size_t offset) -> void
+		{
+			boost::asio::async_read(socket, boost::asio::buffer(tempMsg.body.data() + offset, tempMsg.body.size() - offset),
+				[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 				{
 					if (!ec)
 					{
-						PushIncoming();
+						readCalls.fetch_add(1, std::memory_order_relaxed);
+						bytesRead.fetch_add(length, std::memory_order_relaxed);
+						Count(&IRC::TrafficCounters::bytesIn, uint64_t(length));
+						PushIncoming(std::move(tempMsg));
+						tempMsg = {};
+						ContinueReading();
 					}
 					else
 					{
-						printf("[%d] Read Body Fail.\n", id);
-						socket.close();
+						IRC::Log::Debug("[{}] Read Body Fail: {}", id, ec.message());
+						Close();
 					}
 				});
 		}
 
-		auto PushIncoming() -> void
+		auto Close() -> void
 		{
-			if (owner == Owner::server)
-				inQueue.push_back({ this->shared_from_this(), tempMsg });
-			else
-				inQueue.push_back({ nullptr, tempMsg });
+			if (closed)
+				return;
+
+			closed = true;
+			boost::system::error_code ec;
+			socket.close(ec);
+
+			Count(&IRC::TrafficCounters::outQueueMessages, -static_cast<int64_t>(queuedMessages.load(std::memory_order_relaxed)));
+			Count(&IRC::TrafficCounters::outQueueBytes, -static_cast<int64_t>(queuedBytes.load(std::memory_order_relaxed)));
+			ResumeProducers();
+
+			if (onClose)
+				onClose(this->shared_from_this());
+		}
+
+		auto PushIncoming(IRC::Message<T>&& msg) -> void
+		{
+			messagesRead.fetch_add(1, std::memory_order_relaxed);
+			Count(&IRC::TrafficCounters::messagesIn, uint64_t(1));
+
+			if (IRC::IsHeartbeat(msg.header))
+			{
+				if (owner == Owner::client)
+					SendHeartbeat();
+				return;
+			}
+
+			if ((msg.header.size & IRC::compressedBodyFlag) && !IRC::DecompressBody(msg, maxFrameSize))
+			{
+				IRC::Log::Debug("[{}] Malformed compressed body", id);
+				Close();
+				return;
+			}
 
-			ReadHeader();
+			if (onMessage)
+			{
+				IRC::IdentifyingMessage<T> incoming{ this->shared_from_this(), std::move(msg), std::chrono::steady_clock::now() };
+				onMessage(incoming);
+				return;
+			}
+
+			inQueue.push_back({ this->shared_from_this(), std::move(msg), std::chrono::steady_clock::now() });
+		}
+
+		template<typename Value>
+		auto Count(std::atomic<Value> IRC::TrafficCounters::* counter, Value amount) -> void
+		{
+			if (traffic)
+				(traffic->*counter).fetch_add(amount, std::memory_order_relaxed);
 		}
 
 	protected:
 		boost::asio::ip::tcp::socket socket;
 		boost::asio::io_context& asioContext;
 
-		IRC::ThreadSafeQueue<IRC::Message<T>> outQueue;
-		IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>>& inQueue;
+		// Only touched from handlers running on asioContext.
+		std::deque<IRC::SharedMessage<T>> outQueue;
+		std::vector<boost::asio::const_buffer> writeBuffers;
+		size_t writeOffset = 0;
+		size_t maxWriteBatchBytes = 64 * 1024;
+		static constexpr size_t maxWriteBuffers = 64;
+
+		std::atomic<uint64_t> writeCalls = 0;
+		std::atomic<uint64_t> messagesWritten = 0;
+		std::atomic<uint64_t> bytesWritten = 0;
+
+		IRC::TrafficCounters* traffic = nullptr;
 
+		IRC::OutQueueLimits<T> outQueueLimits;
+		size_t outQueueBytes = 0;
+		bool readsPaused = false;
+		bool readParked = false;
+		uint32_t readPauseHolds = 0;
+
+		// The producers this connection's queue has paused, each held once until it drains.
+		std::unordered_map<Connection<T>*, std::weak_ptr<Connection<T>>> pausedProducers;
+
+		bool compressOutgoing = false;
+		size_t compressionThreshold = 0;
+		IRC::Framing writeFraming = IRC::Framing::v1;
+		IRC::Framing readFraming = IRC::Framing::v1;
+
+		std::atomic<uint64_t> queuedMessages = 0;
+		std::atomic<uint64_t> queuedBytes = 0;
+		std::atomic<uint64_t> peakQueuedBytes = 0;
+		std::atomic<uint64_t> droppedMessages = 0;
+		std::atomic<uint64_t> droppedBytes = 0;
+		std::atomic<uint64_t> readPauses = 0;
+
+		IRC::InboundQueue<T>& inQueue;
+
+		std::vector<uint8_t> readBuffer;
+		size_t readBufferSize = 8 * 1024;
+		size_t readStart = 0;
+		size_t readEnd = 0;
+		size_t maxFrameSize = IRC::defaultMaxFrameSize;
 		IRC::Message<T> tempMsg;
 
+		std::atomic<uint64_t> readCalls = 0;
+		std::atomic<uint64_t> messagesRead = 0;
+		std::atomic<uint64_t> bytesRead = 0;
+
 		Owner owner = Owner::server;
 
 		uint32_t id = 0;
+		uint32_t shard = 0;
+
+		bool closed = false;
+		bool local = false;
+		std::atomic<bool> receivesBroadcasts = true;
+		std::function<void(std::shared_ptr<Connection<T>>)> onClose;
+		std::function<void(IRC::IdentifyingMessage<T>&)> onMessage;
 	};
 }
\ No newline at end of file
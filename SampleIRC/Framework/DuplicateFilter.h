@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Common.h"
+
+#include <unordered_map>
+
+namespace IRC
+{
+	// Tells the first arrival of a message from its repeats, for messages flooded over several paths
+	// and numbered from 1 by the node they started on. Per origin it keeps the highest number seen
+	// and which of the `window` numbers below it have arrived, so a message overtaken on one path by
+	// later ones from another still gets through once. An origin's epoch grows with each of its runs;
+	// a new one starts its numbering over, and messages from an older one are refused. Not thread-safe.
+	class DuplicateFilter
+	{
+	public:
+		static constexpr uint64_t window = 64;
+
+		// True the first time; false for a repeat, for a number `window` or more below the highest
+		// seen from the origin, and for an epoch older than the origin's latest.
+		auto Accept(uint32_t origin, uint64_t epoch, uint64_t sequence) -> bool
+		{
+			Origin& state = origins[origin];
+			if (epoch != state.epoch)
+			{
+				if (epoch < state.epoch)
+					return false;
+				state = { epoch, 0, 0 };
+			}
+
+			if (sequence > state.highest)
+			{
+				const uint64_t ahead = sequence - state.highest;
+				state.seen = (ahead >= window ? 0 : state.seen << ahead) | 1;
+				state.highest = sequence;
+				return true;
+			}
+
+			const uint64_t behind = state.highest - sequence;
+			if (behind >= window || (state.seen & (uint64_t(1) << behind)))
+				return false;
+
+			state.seen |= uint64_t(1) << behind;
+			return true;
+		}
+
+	private:
+		// Bit i of `seen` is highest - i.
+		struct Origin
+		{
+			uint64_t epoch = 0;
+			uint64_t highest = 0;
+			uint64_t seen = 0;
+		};
+
+		std::unordered_map<uint32_t, Origin> origins;
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Common.h"
+#include "Message.h"
+#include "Connection.h"
+
+namespace IRC
+{
+	// Where the handler for a message type runs.
+	enum class Dispatch
+	{
+		queued,		// through the shared inbound queue, on the thread calling Update, in one global order
+		onShard		// on the connection's shard thread as soon as the message is framed
+	};
+
+	template<typename T, typename Owner>
+	struct Route
+	{
+		using Handler = void (Owner::*)(std::shared_ptr<IRC::Connection<T>>, IRC::Message<T>&);
+
+		T id{};
+		Handler handler = nullptr;
+		Dispatch dispatch = Dispatch::queued;
+	};
+
+	// One slot per message type, indexed by the type's value.
+	template<typename T, typename Owner, size_t Count>
+	struct HandlerTable
+	{
+		std::array<Route<T, Owner>, Count> routes{};
+	};
+
+	// Routing a type twice or past Count fails to compile.
+	template<typename T, typename Owner, size_t Count, size_t N>
+	consteval auto MakeHandlerTable(const Route<T, Owner>(&routes)[N]) -> HandlerTable<T, Owner, Count>
+	{
+		HandlerTable<T, Owner, Count> table;
+		for (const auto& route : routes)
+		{
+			const size_t index = static_cast<size_t>(route.id);
+			if (index >= Count || table.routes[index].handler != nullptr)
+				throw "message type routed twice or out of range";
+			table.routes[index] = route;
+		}
+		return table;
+	}
+
+	template<const auto& table, size_t Index, typename Owner, typename T>
+	auto InvokeRoute(Owner& owner, IRC::IdentifyingMessage<T>& incoming, Dispatch from) -> bool
+	{
+		constexpr auto route = table.routes[Index];
+		if constexpr (route.handler == nullptr)
+		{
+			return false;
+		}
+		else
+		{
+			if (from == Dispatch::onShard && route.dispatch != Dispatch::onShard)
+				return false;
+
+			(owner.*route.handler)(incoming.remote, incoming.msg);
+			return true;
+		}
+	}
+
+	// Calls the handler routed for the message's type. Every handler is a compile-time constant, so
+	// this is a jump on the type with direct (inlinable) calls rather than a virtual call and a switch.
+	// Returns false when the type has no route, or when called from the shard for a queued type.
+	template<const auto& table, typename Owner, typename T>
+	auto DispatchMessage(Owner& owner, IRC::IdentifyingMessage<T>& incoming, Dispatch from) -> bool
+	{
+		const size_t index = static_cast<size_t>(incoming.msg.header.id);
+		return [&]<size_t... Index>(std::index_sequence<Index...>)
+		{
+			return ((index == Index && InvokeRoute<table, Index>(owner, incoming, from)) || ...);
+		}(std::make_index_sequence<table.routes.size()>());
+	}
+}
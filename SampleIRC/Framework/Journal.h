@@ -0,0 +1,594 @@
+#pragma once
+
+#include "Common.h"
+#include "Message.h"
+#include "Log.h"
+
+#include <filesystem>
+#include <span>
+#include <tuple>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace IRC
+{
+	// A file mapped read-write in full. Sync writes a byte range back to disk and waits for it.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+		~MappedFile()
+		{
+			Close();
+		}
+
+		// Opens or creates the file, growing it to at least minimumSize; false if any step fails.
+		auto Open(const std::filesystem::path& path, size_t minimumSize) -> bool
+		{
+#if defined(_WIN32)
+			file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER current{};
+			GetFileSizeEx(file, &current);
+			size = std::max(static_cast<size_t>(current.QuadPart), minimumSize);
+
+			LARGE_INTEGER wanted{};
+			wanted.QuadPart = static_cast<LONGLONG>(size);
+			if (!SetFilePointerEx(file, wanted, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+				return false;
+
+			mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+			if (!mapping)
+				return false;
+			data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+			return data != nullptr;
+#else
+			descriptor = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+			if (descriptor < 0)
+				return false;
+
+			struct stat status{};
+			if (::fstat(descriptor, &status) != 0)
+				return false;
+			size = std::max(static_cast<size_t>(status.st_size), minimumSize);
+			if (static_cast<size_t>(status.st_size) < size && ::ftruncate(descriptor, static_cast<off_t>(size)) != 0)
+				return false;
+
+			void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED)
+				return false;
+			data = static_cast<uint8_t*>(address);
+			return true;
+#endif
+		}
+
+		auto Sync(size_t begin, size_t end) -> bool
+		{
+			if (!data || begin >= end)
+				return true;
+
+#if defined(_WIN32)
+			return FlushViewOfFile(data + begin, end - begin) && FlushFileBuffers(file);
+#else
+			// msync wants a page-aligned start.
+			const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+			const size_t alignedBegin = begin - begin % page;
+			return ::msync(data + alignedBegin, end - alignedBegin, MS_SYNC) == 0;
+#endif
+		}
+
+		auto Data() const -> uint8_t*
+		{
+			return data;
+		}
+
+		auto Size() const -> size_t
+		{
+			return size;
+		}
+
+	private:
+		auto Close() -> void
+		{
+#if defined(_WIN32)
+			if (data)
+				UnmapViewOfFile(data);
+			if (mapping)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (data)
+				::munmap(data, size);
+			if (descriptor >= 0)
+				::close(descriptor);
+			descriptor = -1;
+#endif
+			data = nullptr;
+			size = 0;
+		}
+
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int descriptor = -1;
+#endif
+		uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	// When appended records are forced to disk by the journal's flush thread. Appends never wait.
+	enum class JournalDurability
+	{
+		os,			// left to the OS to write back: survives the process crashing, not the machine
+		interval,	// synced every flushInterval
+		immediate	// synced as soon as the flush thread sees new records, several appends per sync
+	};
+
+	struct JournalOptions
+	{
+		std::filesystem::path directory;
+		size_t segmentBytes = 64 * 1024 * 1024;
+		size_t indexInterval = 64;		// records between two sparse index entries
+		JournalDurability durability = JournalDurability::interval;
+		std::chrono::milliseconds flushInterval{ 100 };
+	};
+
+	// Append-only log of encoded frames in fixed-size, memory-mapped segment files. A record is its
+	// sequence number, a wall-clock timestamp, a CRC-32 and the frame's bytes; both keys only ever
+	// grow. Every indexInterval-th record (and each segment's first) goes into a sparse in-memory
+	// index, so a lookup by either key is a binary search plus a short scan. Reads hand out views into
+	// the mappings, along with a reference that keeps the mapping alive. Existing segments in the
+	// directory are picked up again on open.
+	class Journal
+	{
+	public:
+		struct Record
+		{
+			uint64_t sequence;
+			int64_t timestamp;			// nanoseconds since the system clock's epoch
+			std::span<const uint8_t> frame;
+			std::shared_ptr<const void> storage;	// keeps `frame` mapped, even past the journal
+		};
+
+		struct Stats
+		{
+			uint64_t records = 0;
+			uint64_t bytes = 0;
+			uint64_t syncs = 0;
+			uint64_t syncFailures = 0;
+			uint64_t lastSequence = 0;
+			uint64_t syncedSequence = 0;
+		};
+
+		explicit Journal(JournalOptions options)
+			: options(std::move(options))
+		{
+			this->options.indexInterval = std::max<size_t>(this->options.indexInterval, 1);
+			std::error_code ec;
+			std::filesystem::create_directories(this->options.directory, ec);
+			Recover();
+
+			if (this->options.durability != JournalDurability::os)
+				flusher = std::thread([this]() { RunFlusher(); });
+		}
+
+		~Journal()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				running = false;
+			}
+			wake.notify_one();
+			if (flusher.joinable())
+				flusher.join();
+		}
+
+		auto LastSequence() const -> uint64_t
+		{
+			return lastSequence.load(std::memory_order_acquire);
+		}
+
+		// Sequence numbers must grow; a record that does not fit a segment gets one of its own.
+		// Returns false, keeping nothing, for an empty frame, an out-of-order sequence or a segment
+		// that cannot be made.
+		auto Append(uint64_t sequence, std::span<const uint8_t> frame) -> bool
+		{
+			if (frame.empty())
+				return false;
+
+			const size_t recordSize = Align(sizeof(RecordHeader) + frame.size());
+			const uint32_t frameChecksum = Crc32(frame);
+			{
+				std::scoped_lock lock(mutex);
+				if (sequence <= lastSequence.load(std::memory_order_relaxed))
+					return false;
+
+				Segment* segment = segments.empty() ? nullptr : segments.back().get();
+				if (!segment || segment->end.load(std::memory_order_relaxed) + recordSize > segment->file.Size())
+				{
+					segment = AddSegment(sequence, recordSize);
+					if (!segment)
+						return false;
+				}
+
+				// Wall-clock time can step back; the journal's timestamps never do.
+				const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+				lastTimestamp = std::max(lastTimestamp, now);
+
+				const size_t offset = segment->end.load(std::memory_order_relaxed);
+				RecordHeader header{ static_cast<uint32_t>(frame.size()), 0, sequence, lastTimestamp };
+				header.checksum = Checksum(header, frameChecksum);
+				std::memcpy(segment->file.Data() + offset, &header, sizeof(header));
+				std::memcpy(segment->file.Data() + offset + sizeof(header), frame.data(), frame.size());
+
+				if (segment->records++ % options.indexInterval == 0)
+					index.push_back({ sequence, lastTimestamp, static_cast<uint32_t>(segments.size() - 1), offset });
+
+				segment->end.store(offset + recordSize, std::memory_order_release);
+				lastSequence.store(sequence, std::memory_order_release);
+				records.fetch_add(1, std::memory_order_relaxed);
+				bytes.fetch_add(recordSize, std::memory_order_relaxed);
+			}
+
+			if (options.durability == JournalDurability::immediate)
+				wake.notify_one();
+			return true;
+		}
+
+		template<typename T>
+		auto Append(uint64_t sequence, const IRC::EncodedMessage<T>& msg) -> bool
+		{
+			return Append(sequence, std::span<const uint8_t>(msg.data(), msg.size()));
+		}
+
+		// Calls visit(record) for up to maxRecords records, in order, from the first with a sequence
+		// number of at least `from`; returns how many it visited.
+		template<typename Visit>
+		auto ReadFrom(uint64_t from, size_t maxRecords, Visit&& visit) const -> size_t
+		{
+			return Read([from](const IndexEntry& entry) { return entry.sequence <= from; },
+						[from](const RecordHeader& header) { return header.sequence < from; },
+						maxRecords, visit);
+		}
+
+		// The same, from the first record written at or after `timestamp` (system clock, nanoseconds).
+		template<typename Visit>
+		auto ReadFromTime(int64_t timestamp, size_t maxRecords, Visit&& visit) const -> size_t
+		{
+			return Read([timestamp](const IndexEntry& entry) { return entry.timestamp <= timestamp; },
+						[timestamp](const RecordHeader& header) { return header.timestamp < timestamp; },
+						maxRecords, visit);
+		}
+
+		// Under JournalDurability::os nothing here syncs, and writing back is left to the OS; every
+		// record counts as synced then, rather than as a backlog that only ever grows.
+		auto GetStats() const -> Stats
+		{
+			const uint64_t last = lastSequence.load(std::memory_order_relaxed);
+			return { records.load(std::memory_order_relaxed),
+					 bytes.load(std::memory_order_relaxed),
+					 syncs.load(std::memory_order_relaxed),
+					 syncFailures.load(std::memory_order_relaxed),
+					 last,
+					 options.durability == JournalDurability::os ? last : syncedSequence.load(std::memory_order_relaxed) };
+		}
+
+	private:
+		static constexpr uint32_t segmentMagic = 0x4A43'5249u;	// "IRCJ"
+		static constexpr uint32_t segmentVersion = 2;
+
+		struct SegmentHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t firstSequence;
+		};
+
+		// A zero frameSize past the last record marks the end; segments are created zero-filled. The
+		// checksum covers the frame and then this header with the checksum itself taken as 0, so a
+		// record whose header reached the disk without all of its frame is told apart from a whole one.
+		struct RecordHeader
+		{
+			uint32_t frameSize;
+			uint32_t checksum;
+			uint64_t sequence;
+			int64_t timestamp;
+		};
+
+		struct Segment
+		{
+			IRC::MappedFile file;
+			std::atomic<size_t> end = sizeof(SegmentHeader);	// past the last complete record
+			size_t synced = sizeof(SegmentHeader);				// flush thread only
+			size_t records = 0;									// appends only
+		};
+
+		struct IndexEntry
+		{
+			uint64_t sequence;
+			int64_t timestamp;
+			uint32_t segment;
+			size_t offset;
+		};
+
+		static constexpr auto Align(size_t size) -> size_t
+		{
+			return (size + 7) & ~size_t(7);
+		}
+
+		// CRC-32 (IEEE 802.3, as zlib computes it); pass an earlier result as `crc` to carry it on.
+		static auto Crc32(std::span<const uint8_t> bytes, uint32_t crc = 0) -> uint32_t
+		{
+			static constexpr auto table = []()
+				{
+					std::array<uint32_t, 256> entries{};
+					for (uint32_t index = 0; index < 256; index++)
+					{
+						uint32_t value = index;
+						for (int bit = 0; bit < 8; bit++)
+							value = (value >> 1) ^ (value & 1 ? 0xEDB8'8320u : 0);
+						entries[index] = value;
+					}
+					return entries;
+				}();
+
+			crc = ~crc;
+			for (uint8_t byte : bytes)
+				crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+			return ~crc;
+		}
+
+		static auto Checksum(RecordHeader header, uint32_t frameChecksum) -> uint32_t
+		{
+			header.checksum = 0;
+			return Crc32(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(&header), sizeof(header)), frameChecksum);
+		}
+
+		static auto SegmentName(uint64_t firstSequence) -> std::string
+		{
+			char name[48];
+			std::snprintf(name, sizeof(name), "journal-%020llu.log", static_cast<unsigned long long>(firstSequence));
+			return name;
+		}
+
+		// Finds the last index entry at or before the target, then walks records from there. Segments
+		// are only looked up under the lock; their contents up to `end` never change once written.
+		template<typename AtOrBefore, typename Before, typename Visit>
+		auto Read(AtOrBefore atOrBefore, Before before, size_t maxRecords, Visit& visit) const -> size_t
+		{
+			size_t segmentIndex = 0;
+			size_t offset = sizeof(SegmentHeader);
+			std::shared_ptr<const Segment> segment;
+			{
+				std::scoped_lock lock(mutex);
+				if (segments.empty())
+					return 0;
+
+				auto itr = std::partition_point(index.begin(), index.end(), atOrBefore);
+				if (itr != index.begin())
+				{
+					--itr;
+					segmentIndex = itr->segment;
+					offset = itr->offset;
+				}
+				segment = segments[segmentIndex];
+			}
+
+			size_t visited = 0;
+			while (visited < maxRecords)
+			{
+				const size_t end = segment->end.load(std::memory_order_acquire);
+				if (offset + sizeof(RecordHeader) > end)
+				{
+					std::scoped_lock lock(mutex);
+					if (++segmentIndex >= segments.size())
+						break;
+					segment = segments[segmentIndex];
+					offset = sizeof(SegmentHeader);
+					continue;
+				}
+
+				RecordHeader header;
+				std::memcpy(&header, segment->file.Data() + offset, sizeof(header));
+				if (!before(header))
+				{
+					visit(Record{ header.sequence, header.timestamp,
+								  std::span<const uint8_t>(segment->file.Data() + offset + sizeof(header), header.frameSize),
+								  segment });
+					visited++;
+				}
+				offset += Align(sizeof(RecordHeader) + header.frameSize);
+			}
+			return visited;
+		}
+
+		auto AddSegment(uint64_t firstSequence, size_t recordSize) -> Segment*
+		{
+			auto segment = std::make_shared<Segment>();
+			const size_t size = std::max(options.segmentBytes, sizeof(SegmentHeader) + recordSize);
+			const auto path = options.directory / SegmentName(firstSequence);
+			if (!segment->file.Open(path, size))
+			{
+				IRC::Log::Error("[Journal] Cannot map {}", path.string());
+				return nullptr;
+			}
+
+			const SegmentHeader header{ segmentMagic, segmentVersion, firstSequence };
+			std::memcpy(segment->file.Data(), &header, sizeof(header));
+			segments.push_back(std::move(segment));
+			return segments.back().get();
+		}
+
+		// Maps the segments already in the directory, finds where each one's records end and rebuilds
+		// the index. The first record cut short by a crash, out of order or failing its checksum ends
+		// the journal there: the rest of its segment is cleared for new appends, and later segments are
+		// renamed to *.damaged, out of the way of new ones.
+		auto Recover() -> void
+		{
+			std::vector<std::filesystem::path> paths;
+			std::error_code ec;
+			for (const auto& entry : std::filesystem::directory_iterator(options.directory, ec))
+			{
+				const std::string name = entry.path().filename().string();
+				if (name.starts_with("journal-") && name.ends_with(".log"))
+					paths.push_back(entry.path());
+			}
+			std::sort(paths.begin(), paths.end());
+
+			bool damaged = false;
+			for (const auto& path : paths)
+			{
+				if (damaged)
+				{
+					IRC::Log::Warning("[Journal] Setting {} aside, it follows a damaged record", path.string());
+					std::filesystem::rename(path, path.string() + ".damaged", ec);
+					continue;
+				}
+
+				auto segment = std::make_shared<Segment>();
+				SegmentHeader header{};
+				if (!segment->file.Open(path, 0) || segment->file.Size() < sizeof(SegmentHeader))
+					break;
+				std::memcpy(&header, segment->file.Data(), sizeof(header));
+				if (header.magic != segmentMagic || header.version != segmentVersion)
+				{
+					IRC::Log::Warning("[Journal] Skipping {}: not a version {} journal segment", path.string(), segmentVersion);
+					continue;
+				}
+
+				size_t offset = sizeof(SegmentHeader);
+				while (offset + sizeof(RecordHeader) <= segment->file.Size())
+				{
+					RecordHeader record;
+					std::memcpy(&record, segment->file.Data() + offset, sizeof(record));
+					if (record.frameSize == 0)
+						break;
+
+					const size_t recordSize = Align(sizeof(RecordHeader) + record.frameSize);
+					damaged = record.sequence <= lastSequence || offset + recordSize > segment->file.Size()
+						|| Checksum(record, Crc32({ segment->file.Data() + offset + sizeof(record), record.frameSize })) != record.checksum;
+					if (damaged)
+					{
+						IRC::Log::Warning("[Journal] Damaged record in {}; recovering up to #{}", path.string(), lastSequence.load());
+						std::memset(segment->file.Data() + offset, 0, segment->file.Size() - offset);
+						break;
+					}
+
+					if (segment->records++ % options.indexInterval == 0)
+						index.push_back({ record.sequence, record.timestamp, static_cast<uint32_t>(segments.size()), offset });
+					lastSequence = record.sequence;
+					lastTimestamp = record.timestamp;
+					records++;
+					bytes += recordSize;
+					offset += recordSize;
+				}
+
+				segment->end = offset;
+				segment->synced = offset;
+				segments.push_back(std::move(segment));
+			}
+
+			syncedSequence = lastSequence.load();
+			if (!segments.empty())
+				IRC::Log::Info("[Journal] Recovered {} records up to #{}", records.load(), lastSequence.load());
+		}
+
+		// After a failed sync, immediate durability waits out a flush interval too instead of retrying
+		// at once.
+		auto RunFlusher() -> void
+		{
+			std::unique_lock lock(mutex);
+			bool failed = false;
+			while (running)
+			{
+				if (options.durability == JournalDurability::immediate && !failed)
+					wake.wait(lock, [this]() { return !running || syncedSequence.load(std::memory_order_relaxed) != lastSequence.load(std::memory_order_relaxed); });
+				else
+					wake.wait_for(lock, options.flushInterval, [this]() { return !running; });
+
+				failed = !SyncSegments(lock);
+			}
+			SyncSegments(lock);
+		}
+
+		// Syncs outside the lock so appends carry on meanwhile. Only this thread touches `synced`. A
+		// range that fails to sync stays pending for the next pass, and the synced sequence only moves
+		// once every segment up to the target made it; returns false on a failure.
+		auto SyncSegments(std::unique_lock<std::mutex>& lock) -> bool
+		{
+			const uint64_t target = lastSequence.load(std::memory_order_relaxed);
+			std::vector<std::tuple<size_t, Segment*, size_t>> pending;
+			for (size_t segmentIndex = firstUnsynced; segmentIndex < segments.size(); segmentIndex++)
+			{
+				Segment* segment = segments[segmentIndex].get();
+				const size_t end = segment->end.load(std::memory_order_relaxed);
+				if (end > segment->synced)
+					pending.push_back({ segmentIndex, segment, end });
+			}
+			const size_t lastSegment = segments.empty() ? 0 : segments.size() - 1;
+			if (pending.empty())
+			{
+				firstUnsynced = lastSegment;
+				syncedSequence.store(target, std::memory_order_relaxed);
+				return true;
+			}
+
+			lock.unlock();
+			std::optional<size_t> firstFailed;
+			for (auto& [segmentIndex, segment, end] : pending)
+			{
+				if (segment->file.Sync(segment->synced, end))
+					segment->synced = end;
+				else if (!firstFailed)
+					firstFailed = segmentIndex;
+			}
+			lock.lock();
+
+			if (firstFailed)
+			{
+				IRC::Log::Warning("[Journal] Sync failed; retrying from segment {}", *firstFailed);
+				syncFailures.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			firstUnsynced = lastSegment;
+			syncs.fetch_add(1, std::memory_order_relaxed);
+			syncedSequence.store(target, std::memory_order_relaxed);
+			return true;
+		}
+
+		JournalOptions options;
+
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		bool running = true;
+		std::thread flusher;
+
+		// Shared with the records read from them, which can outlive the journal.
+		std::vector<std::shared_ptr<Segment>> segments;
+		std::vector<IndexEntry> index;
+		size_t firstUnsynced = 0;
+		int64_t lastTimestamp = 0;
+
+		std::atomic<uint64_t> lastSequence = 0;
+		std::atomic<uint64_t> syncedSequence = 0;
+		std::atomic<uint64_t> records = 0;
+		std::atomic<uint64_t> bytes = 0;
+		std::atomic<uint64_t> syncs = 0;
+		std::atomic<uint64_t> syncFailures = 0;
+	};
+}
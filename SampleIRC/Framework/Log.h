@@ -0,0 +1,447 @@
+#pragma once
+
+#include "Common.h"
+
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#include <string_view>
+
+// Calls below this level (0 = trace ... 4 = error) compile to nothing.
+#ifndef IRC_LOG_COMPILE_LEVEL
+#define IRC_LOG_COMPILE_LEVEL 0
+#endif
+
+namespace IRC
+{
+	enum class LogLevel : uint8_t
+	{
+		trace,
+		debug,
+		info,
+		warning,
+		error,
+		off
+	};
+
+	// What a call site leaves in the ring: the format string (a literal, never copied), the raw
+	// argument values and any text arguments copied into a small inline buffer. Formatting is
+	// done later on the flusher thread.
+	struct LogRecord
+	{
+		static constexpr size_t maxArguments = 6;
+		static constexpr size_t textCapacity = 64;
+
+		enum class Kind : uint8_t
+		{
+			signedInteger,
+			unsignedInteger,
+			floating,
+			text
+		};
+
+		uint64_t timestamp;
+		const char* format;
+		LogLevel level;
+		uint8_t argumentCount;
+		uint8_t textLength;
+		std::array<Kind, maxArguments> kinds;
+		std::array<uint64_t, maxArguments> values;
+		char text[textCapacity];
+	};
+
+	// Asynchronous logger. Call sites push a LogRecord into a bounded lock-free ring and return;
+	// a background thread formats the records in batches, writes them out and keeps the coarse
+	// clock used for timestamps. When the ring is full records are dropped and counted rather
+	// than blocking the caller. Messages use "{}" placeholders.
+	class Log
+	{
+	public:
+		static constexpr size_t ringCapacity = 8192;
+		static constexpr auto flushInterval = std::chrono::milliseconds(1);
+
+		static auto SetLevel(LogLevel level) -> void
+		{
+			minimumLevel.store(level, std::memory_order_relaxed);
+		}
+
+		static auto Level() -> LogLevel
+		{
+			return minimumLevel.load(std::memory_order_relaxed);
+		}
+
+		static auto ParseLevel(std::string_view name) -> std::optional<LogLevel>
+		{
+			static constexpr std::string_view names[] = { "trace", "debug", "info", "warning", "error", "off" };
+			for (size_t index = 0; index < std::size(names); index++)
+			{
+				if (names[index] == name)
+					return static_cast<LogLevel>(index);
+			}
+			return std::nullopt;
+		}
+
+		static auto IsEnabled(LogLevel level) -> bool
+		{
+			return level >= minimumLevel.load(std::memory_order_relaxed);
+		}
+
+		// Where the flusher writes; stdout by default.
+		static auto SetOutput(FILE* file) -> void
+		{
+			output.store(file, std::memory_order_relaxed);
+		}
+
+		template<typename... Args>
+		static auto Trace(const char* format, const Args&... args) -> void
+		{
+			if constexpr (IRC_LOG_COMPILE_LEVEL <= 0)
+				Write(LogLevel::trace, format, args...);
+		}
+
+		template<typename... Args>
+		static auto Debug(const char* format, const Args&... args) -> void
+		{
+			if constexpr (IRC_LOG_COMPILE_LEVEL <= 1)
+				Write(LogLevel::debug, format, args...);
+		}
+
+		template<typename... Args>
+		static auto Info(const char* format, const Args&... args) -> void
+		{
+			if constexpr (IRC_LOG_COMPILE_LEVEL <= 2)
+				Write(LogLevel::info, format, args...);
+		}
+
+		template<typename... Args>
+		static auto Warning(const char* format, const Args&... args) -> void
+		{
+			if constexpr (IRC_LOG_COMPILE_LEVEL <= 3)
+				Write(LogLevel::warning, format, args...);
+		}
+
+		template<typename... Args>
+		static auto Error(const char* format, const Args&... args) -> void
+		{
+			if constexpr (IRC_LOG_COMPILE_LEVEL <= 4)
+				Write(LogLevel::error, format, args...);
+		}
+
+		template<typename... Args>
+		static auto Write(LogLevel level, const char* format, const Args&... args) -> void
+		{
+			static_assert(sizeof...(Args) <= LogRecord::maxArguments, "Too many log arguments");
+
+			if (!IsEnabled(level))
+				return;
+
+			Backend& backend = Instance();
+			auto* cell = backend.Claim();
+			if (!cell)
+				return;
+
+			LogRecord* record = &cell->record;
+			record->timestamp = backend.coarseNow.load(std::memory_order_relaxed);
+			record->format = format;
+			record->level = level;
+			record->argumentCount = 0;
+			record->textLength = 0;
+			(Capture(*record, args), ...);
+
+			backend.Publish(cell);
+		}
+
+		// Blocks until everything logged before the call has been written out.
+		static auto Flush() -> void
+		{
+			Backend& backend = Instance();
+			const size_t target = backend.enqueuePosition.load(std::memory_order_acquire);
+			while (backend.flushedPosition.load(std::memory_order_acquire) < target)
+				std::this_thread::sleep_for(flushInterval);
+		}
+
+		// Milliseconds since the epoch, refreshed by the flusher every flushInterval.
+		static auto CoarseNow() -> uint64_t
+		{
+			return Instance().coarseNow.load(std::memory_order_relaxed);
+		}
+
+		static auto DroppedRecords() -> uint64_t
+		{
+			return Instance().droppedTotal.load(std::memory_order_relaxed);
+		}
+
+	private:
+		template<typename Arg>
+		static auto Capture(LogRecord& record, const Arg& arg) -> void
+		{
+			const size_t index = record.argumentCount++;
+			auto& kind = record.kinds[index];
+			auto& value = record.values[index];
+
+			if constexpr (std::is_same_v<Arg, bool>)
+			{
+				kind = LogRecord::Kind::unsignedInteger;
+				value = arg ? 1 : 0;
+			}
+			else if constexpr (std::is_enum_v<Arg>)
+			{
+				kind = LogRecord::Kind::signedInteger;
+				value = static_cast<uint64_t>(static_cast<int64_t>(arg));
+			}
+			else if constexpr (std::is_integral_v<Arg> && std::is_signed_v<Arg>)
+			{
+				kind = LogRecord::Kind::signedInteger;
+				value = static_cast<uint64_t>(static_cast<int64_t>(arg));
+			}
+			else if constexpr (std::is_integral_v<Arg>)
+			{
+				kind = LogRecord::Kind::unsignedInteger;
+				value = static_cast<uint64_t>(arg);
+			}
+			else if constexpr (std::is_floating_point_v<Arg>)
+			{
+				const double number = static_cast<double>(arg);
+				kind = LogRecord::Kind::floating;
+				std::memcpy(&value, &number, sizeof(number));
+			}
+			else
+			{
+				static_assert(std::is_convertible_v<const Arg&, std::string_view>, "Argument type cannot be logged");
+
+				// Text is truncated to whatever is left of the record's buffer.
+				const std::string_view text(arg);
+				const size_t length = std::min(text.size(), LogRecord::textCapacity - record.textLength);
+				std::memcpy(record.text + record.textLength, text.data(), length);
+
+				kind = LogRecord::Kind::text;
+				value = (static_cast<uint64_t>(record.textLength) << 32) | length;
+				record.textLength += static_cast<uint8_t>(length);
+			}
+		}
+
+		// Bounded multi-producer ring (Vyukov): each cell's sequence says whose turn it is, so
+		// producers only contend on enqueuePosition and never wait for each other.
+		struct Backend
+		{
+			struct Cell
+			{
+				std::atomic<size_t> sequence;
+				LogRecord record;
+			};
+
+			Backend()
+				: cells(ringCapacity)
+			{
+				for (size_t index = 0; index < ringCapacity; index++)
+					cells[index].sequence.store(index, std::memory_order_relaxed);
+
+				coarseNow.store(SystemMilliseconds(), std::memory_order_relaxed);
+				flusher = std::thread([this]() { Run(); });
+			}
+
+			~Backend()
+			{
+				running.store(false, std::memory_order_relaxed);
+				if (flusher.joinable())
+					flusher.join();
+			}
+
+			auto Claim() -> Cell*
+			{
+				size_t position = enqueuePosition.load(std::memory_order_relaxed);
+				for (;;)
+				{
+					Cell& cell = cells[position & (ringCapacity - 1)];
+					const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+					const auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+
+					if (lag == 0)
+					{
+						if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+							return &cell;
+					}
+					else if (lag < 0)
+					{
+						dropped.fetch_add(1, std::memory_order_relaxed);
+						return nullptr;
+					}
+					else
+					{
+						position = enqueuePosition.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+			auto Publish(Cell* cell) -> void
+			{
+				const size_t position = cell->sequence.load(std::memory_order_relaxed);
+				cell->sequence.store(position + 1, std::memory_order_release);
+			}
+
+			auto Run() -> void
+			{
+				std::string buffer;
+				bool stopping = false;
+
+				while (!stopping)
+				{
+					stopping = !running.load(std::memory_order_relaxed);
+					coarseNow.store(SystemMilliseconds(), std::memory_order_relaxed);
+
+					Drain(buffer);
+					if (!buffer.empty())
+					{
+						FILE* file = output.load(std::memory_order_relaxed);
+						std::fwrite(buffer.data(), 1, buffer.size(), file);
+						std::fflush(file);
+						buffer.clear();
+					}
+					flushedPosition.store(dequeuePosition, std::memory_order_release);
+
+					if (!stopping)
+						std::this_thread::sleep_for(flushInterval);
+				}
+			}
+
+			auto Drain(std::string& buffer) -> void
+			{
+				for (;;)
+				{
+					Cell& cell = cells[dequeuePosition & (ringCapacity - 1)];
+					if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+						break;
+
+					Format(buffer, cell.record);
+					cell.sequence.store(dequeuePosition + ringCapacity, std::memory_order_release);
+					dequeuePosition++;
+				}
+
+				if (const uint64_t lost = dropped.exchange(0, std::memory_order_relaxed))
+				{
+					droppedTotal.fetch_add(lost, std::memory_order_relaxed);
+
+					LogRecord notice{};
+					notice.timestamp = coarseNow.load(std::memory_order_relaxed);
+					notice.format = "[Log] Ring full, {} record(s) dropped";
+					notice.level = LogLevel::warning;
+					notice.argumentCount = 1;
+					notice.kinds[0] = LogRecord::Kind::unsignedInteger;
+					notice.values[0] = lost;
+					Format(buffer, notice);
+				}
+			}
+
+			auto Format(std::string& buffer, const LogRecord& record) -> void
+			{
+				static constexpr const char* levelNames[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+				AppendTimestamp(buffer, record.timestamp);
+				buffer += levelNames[static_cast<size_t>(record.level)];
+				buffer += ' ';
+
+				size_t argument = 0;
+				for (const char* itr = record.format; *itr; itr++)
+				{
+					if (itr[0] == '{' && itr[1] == '}' && argument < record.argumentCount)
+					{
+						AppendArgument(buffer, record, argument++);
+						itr++;
+					}
+					else
+					{
+						buffer += *itr;
+					}
+				}
+				buffer += '\n';
+			}
+
+			static auto AppendArgument(std::string& buffer, const LogRecord& record, size_t index) -> void
+			{
+				char digits[32];
+				std::to_chars_result result{ digits, {} };
+				const uint64_t value = record.values[index];
+
+				switch (record.kinds[index])
+				{
+				case LogRecord::Kind::signedInteger:
+					result = std::to_chars(digits, std::end(digits), static_cast<int64_t>(value));
+					break;
+
+				case LogRecord::Kind::unsignedInteger:
+					result = std::to_chars(digits, std::end(digits), value);
+					break;
+
+				case LogRecord::Kind::floating:
+				{
+					double number;
+					std::memcpy(&number, &value, sizeof(number));
+					result = std::to_chars(digits, std::end(digits), number, std::chars_format::fixed, 3);
+					if (result.ec != std::errc())
+						result = std::to_chars(digits, std::end(digits), number);
+					break;
+				}
+
+				case LogRecord::Kind::text:
+					buffer.append(record.text + (value >> 32), static_cast<size_t>(value & UINT32_MAX));
+					return;
+				}
+
+				buffer.append(digits, result.ptr);
+			}
+
+			// localtime only runs when the second changes.
+			auto AppendTimestamp(std::string& buffer, uint64_t milliseconds) -> void
+			{
+				const uint64_t second = milliseconds / 1000;
+				if (second != cachedSecond)
+				{
+					const std::time_t time = static_cast<std::time_t>(second);
+					std::tm local{};
+#if defined(_WIN32)
+					localtime_s(&local, &time);
+#else
+					localtime_r(&time, &local);
+#endif
+					std::snprintf(cachedClock, sizeof(cachedClock), "[%02d:%02d:%02d.", local.tm_hour, local.tm_min, local.tm_sec);
+					cachedSecond = second;
+				}
+
+				char fraction[8];
+				std::snprintf(fraction, sizeof(fraction), "%03u] ", static_cast<unsigned>(milliseconds % 1000));
+				buffer += cachedClock;
+				buffer += fraction;
+			}
+
+			static auto SystemMilliseconds() -> uint64_t
+			{
+				return std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+			}
+
+			std::vector<Cell> cells;
+			alignas(64) std::atomic<size_t> enqueuePosition = 0;
+			alignas(64) std::atomic<uint64_t> coarseNow = 0;
+			std::atomic<uint64_t> dropped = 0;
+			std::atomic<uint64_t> droppedTotal = 0;
+
+			// Flusher thread only.
+			alignas(64) size_t dequeuePosition = 0;
+			std::atomic<size_t> flushedPosition = 0;
+			uint64_t cachedSecond = UINT64_MAX;
+			char cachedClock[16] = {};
+
+			std::atomic<bool> running = true;
+			std::thread flusher;
+		};
+
+		static auto Instance() -> Backend&
+		{
+			static Backend backend;
+			return backend;
+		}
+
+		static inline std::atomic<LogLevel> minimumLevel = LogLevel::info;
+		static inline std::atomic<FILE*> output = stdout;
+	};
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Common.h"
+
+namespace IRC
+{
+	// Lock-free multi-producer / single-consumer queue (Vyukov's linked-list design).
+	// Any thread may push; only one thread at a time may pop, drain or wait.
+	template<typename T>
+	class MPSCQueue
+	{
+	public:
+		MPSCQueue()
+			: head(new Node()), tail(head.load())
+		{ }
+
+		MPSCQueue(const MPSCQueue<T>&) = delete;
+
+		virtual ~MPSCQueue()
+		{
+			clear();
+			delete tail;
+		}
+
+	public:
+		auto push_back(const T& item) -> void
+		{
+			Enqueue(new Node(item));
+		}
+
+		auto push_back(T&& item) -> void
+		{
+			Enqueue(new Node(std::move(item)));
+		}
+
+		auto try_pop(T& item) -> bool
+		{
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return false;
+
+			item = std::move(*next->value);
+			next->value.reset();
+			delete tail;
+			tail = next;
+			itemCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		auto pop_front() -> T
+		{
+			T item;
+			while (!try_pop(item))
+				std::this_thread::yield();
+			return item;
+		}
+
+		// Moves up to maxItems queued items onto the end of batch; returns how many were moved.
+		auto drain(std::vector<T>& batch, size_t maxItems = SIZE_MAX) -> size_t
+		{
+			size_t drained = 0;
+			Node* next = nullptr;
+
+			while (drained < maxItems && (next = tail->next.load(std::memory_order_acquire)) != nullptr)
+			{
+				batch.push_back(std::move(*next->value));
+				next->value.reset();
+				delete tail;
+				tail = next;
+				drained++;
+			}
+
+			itemCount.fetch_sub(drained, std::memory_order_relaxed);
+			return drained;
+		}
+
+		auto empty() -> bool
+		{
+			return tail->next.load(std::memory_order_acquire) == nullptr;
+		}
+
+		auto count() -> std::size_t
+		{
+			return itemCount.load(std::memory_order_relaxed);
+		}
+
+		auto clear() -> void
+		{
+			T item;
+			while (try_pop(item)) { }
+		}
+
+		// Spins briefly, then yields, then parks on an atomic wait. A producer only signals when the
+		// consumer has announced it is parked; the seq_cst fences on both sides guarantee that either
+		// the consumer sees the new item or the producer sees the parked flag.
+		auto wait() -> void
+		{
+			for (int spin = 0; spin < spinIterations; spin++)
+			{
+				if (!empty()) return;
+			}
+
+			for (int spin = 0; spin < yieldIterations; spin++)
+			{
+				if (!empty()) return;
+				std::this_thread::yield();
+			}
+
+			while (empty())
+			{
+				const uint32_t observed = wakeSignal.load(std::memory_order_acquire);
+				parked.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				if (empty())
+					wakeSignal.wait(observed, std::memory_order_acquire);
+
+				parked.store(false, std::memory_order_relaxed);
+			}
+		}
+
+	private:
+		struct Node
+		{
+			Node() = default;
+			explicit Node(const T& item) : value(item) { }
+			explicit Node(T&& item) : value(std::move(item)) { }
+
+			std::atomic<Node*> next = nullptr;
+			std::optional<T> value;
+		};
+
+		auto Enqueue(Node* node) -> void
+		{
+			itemCount.fetch_add(1, std::memory_order_relaxed);
+
+			Node* previous = head.exchange(node, std::memory_order_acq_rel);
+			previous->next.store(node, std::memory_order_release);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (parked.load(std::memory_order_relaxed))
+			{
+				wakeSignal.fetch_add(1, std::memory_order_release);
+				wakeSignal.notify_one();
+			}
+		}
+
+		static constexpr int spinIterations = 256;
+		static constexpr int yieldIterations = 16;
+
+		alignas(64) std::atomic<Node*> head;
+		alignas(64) Node* tail;
+		alignas(64) std::atomic<size_t> itemCount = 0;
+		std::atomic<bool> parked = false;
+		std::atomic<uint32_t> wakeSignal = 0;
+	};
+}
@@ -1,11 +1,37 @@
 ﻿#pragma once
 #include "Common.h"
+#include "MessageBody.h"
+#include "Compression.h"
+
+#include <span>
 
 namespace IRC
 {
 	template <typename T>
 	class Connection;
 
+	// Optional wire features, advertised by the server in its handshake and picked by the client.
+	namespace Capability
+	{
+		constexpr uint32_t compression = 1u << 0;
+		constexpr uint32_t compactFraming = 1u << 1;
+	}
+
+	// The top bit of Header::size marks an LZ4-compressed body: the uncompressed size as a uint32_t,
+	// then the compressed block. Below it are the stream flags, and the low 29 bits are the body's
+	// size on the wire.
+	constexpr uint32_t compressedBodyFlag = 0x8000'0000u;
+	constexpr uint32_t maxDecompressedBodySize = 64 * 1024 * 1024;
+
+	// A body too large for one frame goes as a stream: a run of frames of the same type, each a
+	// complete message of its own, all flagged streamChunkFlag and the last one also endOfStreamFlag.
+	// The receiver hands every chunk to its handler as it arrives instead of assembling the whole.
+	constexpr uint32_t streamChunkFlag = 0x4000'0000u;
+	constexpr uint32_t endOfStreamFlag = 0x2000'0000u;
+	constexpr uint32_t streamFlags = streamChunkFlag | endOfStreamFlag;
+	constexpr uint32_t frameFlags = compressedBodyFlag | streamFlags;
+	constexpr uint32_t defaultMaxFrameSize = 1024 * 1024;
+
 	template <typename T>
 	struct Header
 	{
@@ -13,11 +39,122 @@ namespace IRC
 		uint32_t size = 0;
 	};
 
+	// How frames are laid out on a connection, per direction. v1 is Header<T> followed by the body.
+	// compact is a type byte, an optional flags byte and a LEB128 body length: 2 bytes of framing for
+	// most messages instead of 8. Each direction starts on v1 and moves to compact after sending a
+	// v1 frame with id framingUpgradeId, which is only done once the peer has offered compactFraming.
+	enum class Framing : uint8_t
+	{
+		v1,
+		compact
+	};
+
+	constexpr uint32_t framingUpgradeId = 0xFFFF'FFFFu;
+
+	// An empty frame the server sends to a connection that has gone quiet. The client's Connection
+	// answers it with the same frame; neither side passes it on to handlers.
+	constexpr uint32_t heartbeatId = 0xFFFF'FFFEu;
+
+	namespace CompactHeader
+	{
+		constexpr uint8_t flagsFollow = 0x80;		// in the type byte
+		constexpr uint8_t extendedType = 0x7F;		// type byte value: the type follows as a varint
+		constexpr uint8_t compressed = 0x01;		// in the flags byte
+		constexpr uint8_t streamChunk = 0x02;
+		constexpr uint8_t endOfStream = 0x04;
+		constexpr size_t maxSize = 1 + 5 + 1 + 5;
+
+		inline auto WriteVarint(uint8_t* out, uint32_t value) -> size_t
+		{
+			size_t length = 0;
+			while (value >= 0x80)
+			{
+				out[length++] = static_cast<uint8_t>(value) | 0x80;
+				value >>= 7;
+			}
+			out[length++] = static_cast<uint8_t>(value);
+			return length;
+		}
+
+		// 0 if the varint is not complete yet, -1 if it runs past five bytes.
+		inline auto ReadVarint(const uint8_t* in, size_t available, uint32_t& value) -> ptrdiff_t
+		{
+			value = 0;
+			for (size_t index = 0; index < 5; index++)
+			{
+				if (index == available)
+					return 0;
+				value |= static_cast<uint32_t>(in[index] & 0x7F) << (7 * index);
+				if ((in[index] & 0x80) == 0)
+					return static_cast<ptrdiff_t>(index + 1);
+			}
+			return -1;
+		}
+
+		template <typename T>
+		auto Write(const Header<T>& header, uint8_t* out) -> size_t
+		{
+			const uint32_t type = static_cast<uint32_t>(header.id);
+			const uint8_t flags = ((header.size & compressedBodyFlag) ? compressed : 0)
+				| ((header.size & streamChunkFlag) ? streamChunk : 0)
+				| ((header.size & endOfStreamFlag) ? endOfStream : 0);
+
+			size_t length = 1;
+			out[0] = static_cast<uint8_t>(type < extendedType ? type : extendedType) | (flags ? flagsFollow : 0);
+			if (type >= extendedType)
+				length += WriteVarint(out + length, type);
+			if (flags)
+				out[length++] = flags;
+			return length + WriteVarint(out + length, header.size & ~frameFlags);
+		}
+
+		// Returns the header's size, 0 if more bytes are needed, or -1 if it is malformed. Compressed
+		// bodies and stream chunks come back flagged in header.size, as in v1.
+		template <typename T>
+		auto Read(const uint8_t* in, size_t available, Header<T>& header) -> ptrdiff_t
+		{
+			if (available == 0)
+				return 0;
+
+			size_t length = 1;
+			uint32_t type = in[0] & ~flagsFollow;
+			if (type == extendedType)
+			{
+				const ptrdiff_t read = ReadVarint(in + length, available - length, type);
+				if (read <= 0)
+					return read;
+				length += read;
+			}
+
+			uint8_t flags = 0;
+			if (in[0] & flagsFollow)
+			{
+				if (length == available)
+					return 0;
+				flags = in[length++];
+			}
+
+			uint32_t size = 0;
+			const ptrdiff_t read = ReadVarint(in + length, available - length, size);
+			if (read <= 0)
+				return read;
+			if (size & frameFlags)
+				return -1;
+
+			header.id = static_cast<T>(type);
+			header.size = size
+				| ((flags & compressed) ? compressedBodyFlag : 0)
+				| ((flags & streamChunk) ? streamChunkFlag : 0)
+				| ((flags & endOfStream) ? endOfStreamFlag : 0);
+			return static_cast<ptrdiff_t>(length + read);
+		}
+	}
+
 	template <typename T>
 	struct Message
 	{
 		Header<T> header{};
-		std::vector<uint8_t> body;
+		IRC::MessageBody body;
 
 		size_t size() const
 		{
@@ -52,11 +189,220 @@ namespace IRC
 	};
 
 
+	// A message encoded once into its wire form (header followed by body). Immutable, so a single
+	// instance can sit in the out-queues of any number of connections at the same time.
+	template <typename T>
+	class EncodedMessage
+	{
+	public:
+		explicit EncodedMessage(const Message<T>& msg)
+			: bytes(sizeof(Header<T>) + msg.body.size()),
+			frame(bytes),
+			wireHeader(msg.header)
+		{
+			wireHeader.size = static_cast<uint32_t>(msg.body.size()) | (msg.header.size & streamFlags);
+
+			std::memcpy(bytes.data(), &wireHeader, sizeof(Header<T>));
+			if (!msg.body.empty())
+				std::memcpy(bytes.data() + sizeof(Header<T>), msg.body.data(), msg.body.size());
+		}
+
+		// A complete v1 frame, as written by an earlier EncodedMessage, sent from where it already is:
+		// nothing is copied, and the message holds on to `storage`, whatever keeps those bytes alive.
+		// Null unless the header's size matches the bytes that follow it.
+		static auto FromFrame(std::span<const uint8_t> stored, std::shared_ptr<const void> storage) -> std::shared_ptr<const EncodedMessage>
+		{
+			Header<T> header;
+			if (stored.size() < sizeof(Header<T>))
+				return nullptr;
+			std::memcpy(&header, stored.data(), sizeof(Header<T>));
+			if ((header.size & ~frameFlags) != stored.size() - sizeof(Header<T>))
+				return nullptr;
+
+			return std::shared_ptr<const EncodedMessage>(new EncodedMessage(stored, std::move(storage), header));
+		}
+
+		// The v1 header, whichever framing the bytes are in.
+		auto header() const -> Header<T>
+		{
+			return wireHeader;
+		}
+
+		auto data() const -> const uint8_t*
+		{
+			return frame.data();
+		}
+
+		auto size() const -> size_t
+		{
+			return frame.size();
+		}
+
+		// The same message in compact framing, built once and shared like compressed(). Only v1 forms
+		// (including compressed ones) have one.
+		auto compact() const -> const EncodedMessage*
+		{
+			std::call_once(compactOnce, [this]()
+				{
+					const size_t bodySize = size() - sizeof(Header<T>);
+					std::vector<uint8_t> framed(CompactHeader::maxSize + bodySize);
+
+					const size_t headerSize = CompactHeader::Write(wireHeader, framed.data());
+					if (bodySize > 0)
+						std::memcpy(framed.data() + headerSize, data() + sizeof(Header<T>), bodySize);
+					framed.resize(headerSize + bodySize);
+
+					compactForm.reset(new EncodedMessage(std::move(framed), wireHeader));
+				});
+			return compactForm.get();
+		}
+
+		// The same message with its body compressed, built once by whichever thread first asks and
+		// then shared by every connection sending it. Null if the body does not get smaller.
+		auto compressed() const -> const EncodedMessage*
+		{
+			std::call_once(compressOnce, [this]()
+				{
+					const size_t bodySize = size() - sizeof(Header<T>);
+					std::vector<uint8_t> packed(sizeof(Header<T>) + sizeof(uint32_t) + IRC::Lz4::Bound(bodySize));
+
+					const size_t blockSize = IRC::Lz4::Compress(data() + sizeof(Header<T>), bodySize,
+																packed.data() + sizeof(Header<T>) + sizeof(uint32_t),
+																packed.size() - sizeof(Header<T>) - sizeof(uint32_t));
+					if (blockSize == 0 || sizeof(uint32_t) + blockSize >= bodySize)
+						return;
+
+					Header<T> packedHeader = wireHeader;
+					packedHeader.size = static_cast<uint32_t>(sizeof(uint32_t) + blockSize) | compressedBodyFlag | (wireHeader.size & streamFlags);
+					const uint32_t rawSize = static_cast<uint32_t>(bodySize);
+					std::memcpy(packed.data(), &packedHeader, sizeof(Header<T>));
+					std::memcpy(packed.data() + sizeof(Header<T>), &rawSize, sizeof(uint32_t));
+					packed.resize(sizeof(Header<T>) + sizeof(uint32_t) + blockSize);
+
+					compressedForm.reset(new EncodedMessage(std::move(packed), packedHeader));
+				});
+			return compressedForm.get();
+		}
+
+	private:
+		EncodedMessage(std::vector<uint8_t> encoded, const Header<T>& header)
+			: bytes(std::move(encoded)),
+			frame(bytes),
+			wireHeader(header)
+		{ }
+
+		EncodedMessage(std::span<const uint8_t> stored, std::shared_ptr<const void> storage, const Header<T>& header)
+			: storage(std::move(storage)),
+			frame(stored),
+			wireHeader(header)
+		{ }
+
+		// The frame is either in `bytes` or, for FromFrame, in memory that `storage` keeps alive.
+		std::vector<uint8_t> bytes;
+		std::shared_ptr<const void> storage;
+		std::span<const uint8_t> frame;
+		Header<T> wireHeader;
+		mutable std::once_flag compressOnce;
+		mutable std::unique_ptr<const EncodedMessage> compressedForm;
+		mutable std::once_flag compactOnce;
+		mutable std::unique_ptr<const EncodedMessage> compactForm;
+	};
+
+	template <typename T>
+	using SharedMessage = std::shared_ptr<const EncodedMessage<T>>;
+
+	template <typename T>
+	auto MakeSharedMessage(const Message<T>& msg) -> SharedMessage<T>
+	{
+		return std::make_shared<const EncodedMessage<T>>(msg);
+	}
+
+	// What a connection that negotiated compression sends: the compressed form for bodies of at least
+	// `threshold` bytes that shrink, otherwise the message itself. The result shares msg's ownership.
+	template <typename T>
+	auto CompressedMessage(const SharedMessage<T>& msg, size_t threshold) -> SharedMessage<T>
+	{
+		if (msg->size() - sizeof(Header<T>) < threshold)
+			return msg;
+
+		if (const EncodedMessage<T>* compressed = msg->compressed())
+			return SharedMessage<T>(msg, compressed);
+		return msg;
+	}
+
+	template <typename T>
+	auto CompactMessage(const SharedMessage<T>& msg) -> SharedMessage<T>
+	{
+		return SharedMessage<T>(msg, msg->compact());
+	}
+
+	template <typename T>
+	auto IsFramingUpgrade(const Header<T>& header) -> bool
+	{
+		return static_cast<uint32_t>(header.id) == framingUpgradeId;
+	}
+
+	template <typename T>
+	auto IsStreamChunk(const Header<T>& header) -> bool
+	{
+		return (header.size & streamChunkFlag) != 0;
+	}
+
+	template <typename T>
+	auto IsEndOfStream(const Header<T>& header) -> bool
+	{
+		return (header.size & endOfStreamFlag) != 0;
+	}
+
+	// The body's size without the frame flags.
+	template <typename T>
+	auto BodySize(const Header<T>& header) -> uint32_t
+	{
+		return header.size & ~frameFlags;
+	}
+
+	// Flags an encoded message as one chunk of a stream; `last` ends the stream.
+	template <typename T>
+	auto MarkStreamChunk(Message<T>& msg, bool last) -> void
+	{
+		msg.header.size = static_cast<uint32_t>(msg.body.size()) | streamChunkFlag | (last ? endOfStreamFlag : 0);
+	}
+
+	template <typename T>
+	auto IsHeartbeat(const Header<T>& header) -> bool
+	{
+		return static_cast<uint32_t>(header.id) == heartbeatId;
+	}
+
+	// Replaces a compressed body with the original; false if it is malformed or would decompress to
+	// more than maxSize bytes.
+	template <typename T>
+	auto DecompressBody(Message<T>& msg, size_t maxSize = maxDecompressedBodySize) -> bool
+	{
+		uint32_t rawSize = 0;
+		if (msg.body.size() < sizeof(rawSize))
+			return false;
+		std::memcpy(&rawSize, msg.body.data(), sizeof(rawSize));
+		if (rawSize > maxSize || rawSize > maxDecompressedBodySize)
+			return false;
+
+		IRC::MessageBody raw;
+		raw.resize(rawSize);
+		if (!IRC::Lz4::Decompress(msg.body.data() + sizeof(rawSize), msg.body.size() - sizeof(rawSize), raw.data(), rawSize))
+			return false;
+
+		msg.body = std::move(raw);
+		msg.header.size = rawSize | (msg.header.size & streamFlags);
+		return true;
+	}
+
+
 	template <typename T>
 	struct IdentifyingMessage
 	{
 		std::shared_ptr<IRC::Connection<T>> remote = nullptr;
 		IRC::Message<T> msg;
+		std::chrono::steady_clock::time_point queuedAt = {};
 	};
 
 }
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "Common.h"
+
+namespace IRC
+{
+	struct MessageBodyStats
+	{
+		uint64_t heapAllocations = 0;
+		uint64_t heapReleases = 0;
+		uint64_t poolReuses = 0;
+		uint64_t crossThreadReleases = 0;
+	};
+
+	// Per-thread caches of power-of-two blocks for bodies that do not fit inline.
+	// A cache keeps up to maxCachedBytesPerClass (and at least minCachedBlocks) of each size class;
+	// the rest goes back to the heap. Every block remembers the cache it came from: released on that
+	// cache's thread it goes straight back on a free list, released on any other thread it is pushed
+	// onto the owner's lock-free return stack, which the owner takes back whole once a free list runs
+	// dry. A body framed on a shard thread and dropped on a handler thread so still ends up back on the
+	// shard. The cache of a thread that exits is parked, with everything in it, for the next new thread.
+	class BodyPool
+	{
+	public:
+		static constexpr size_t minBlockSize = 256;
+		static constexpr size_t maxBlockSize = 64 * 1024;
+		static constexpr size_t maxCachedBytesPerClass = 1024 * 1024;
+		static constexpr size_t minCachedBlocks = 64;
+
+		struct Cache;
+
+		// `owner` is what Release needs back; null for blocks larger than maxBlockSize.
+		static auto Allocate(size_t bytes, size_t& capacity, Cache*& owner) -> uint8_t*
+		{
+			const size_t sizeClass = SizeClass(bytes);
+			owner = nullptr;
+			if (sizeClass >= classCount)
+			{
+				capacity = bytes;
+				heapAllocations.fetch_add(1, std::memory_order_relaxed);
+				return static_cast<uint8_t*>(::operator new(capacity));
+			}
+
+			capacity = minBlockSize << sizeClass;
+			Cache* cache = threadCache.cache;
+			if (cache)
+			{
+				owner = cache;
+				auto& freeList = cache->freeLists[sizeClass];
+				if (freeList.empty() && cache->returned.load(std::memory_order_relaxed))
+					Reclaim(*cache);
+
+				if (!freeList.empty())
+				{
+					uint8_t* block = freeList.back();
+					freeList.pop_back();
+					poolReuses.fetch_add(1, std::memory_order_relaxed);
+					return block;
+				}
+			}
+
+			heapAllocations.fetch_add(1, std::memory_order_relaxed);
+			return static_cast<uint8_t*>(::operator new(capacity));
+		}
+
+		static auto Release(uint8_t* block, size_t capacity, Cache* owner) -> void
+		{
+			if (owner && owner == threadCache.cache)
+			{
+				if (!Keep(*owner, block, SizeClass(capacity)))
+					Free(block);
+			}
+			else if (owner)
+			{
+				// The block is large enough to carry its own link while it waits on the stack.
+				auto* node = reinterpret_cast<ReturnedBlock*>(block);
+				node->sizeClass = SizeClass(capacity);
+				node->next = owner->returned.load(std::memory_order_relaxed);
+				while (!owner->returned.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+				{ }
+				crossThreadReleases.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				Free(block);
+			}
+		}
+
+		static auto Stats() -> MessageBodyStats
+		{
+			return { heapAllocations.load(std::memory_order_relaxed),
+					 heapReleases.load(std::memory_order_relaxed),
+					 poolReuses.load(std::memory_order_relaxed),
+					 crossThreadReleases.load(std::memory_order_relaxed) };
+		}
+
+	private:
+		static constexpr size_t classCount = 9;
+
+		struct ReturnedBlock
+		{
+			ReturnedBlock* next;
+			size_t sizeClass;
+		};
+
+	public:
+		struct Cache
+		{
+			std::array<std::vector<uint8_t*>, classCount> freeLists;
+			std::atomic<ReturnedBlock*> returned = nullptr;
+		};
+
+	private:
+		// Parked caches are never freed: there are at most as many as threads were ever alive at once,
+		// and blocks released on other threads may still be on their way back to them.
+		struct ThreadCache
+		{
+			ThreadCache()
+			{
+				std::scoped_lock lock(parkedMutex);
+				if (parked.empty())
+				{
+					cache = new Cache();
+				}
+				else
+				{
+					cache = parked.back();
+					parked.pop_back();
+				}
+			}
+
+			~ThreadCache()
+			{
+				std::scoped_lock lock(parkedMutex);
+				parked.push_back(cache);
+				cache = nullptr;
+			}
+
+			Cache* cache = nullptr;
+		};
+
+		static auto SizeClass(size_t bytes) -> size_t
+		{
+			size_t sizeClass = 0;
+			while (sizeClass < classCount && (minBlockSize << sizeClass) < bytes)
+				sizeClass++;
+			return sizeClass;
+		}
+
+		static auto Keep(Cache& cache, uint8_t* block, size_t sizeClass) -> bool
+		{
+			auto& freeList = cache.freeLists[sizeClass];
+			if (freeList.size() >= std::max(minCachedBlocks, maxCachedBytesPerClass / (minBlockSize << sizeClass)))
+				return false;
+
+			freeList.push_back(block);
+			return true;
+		}
+
+		// One exchange takes every block released to this cache from other threads.
+		static auto Reclaim(Cache& cache) -> void
+		{
+			ReturnedBlock* node = cache.returned.exchange(nullptr, std::memory_order_acquire);
+			while (node)
+			{
+				ReturnedBlock* next = node->next;
+				auto* block = reinterpret_cast<uint8_t*>(node);
+				if (!Keep(cache, block, node->sizeClass))
+					Free(block);
+				node = next;
+			}
+		}
+
+		static auto Free(uint8_t* block) -> void
+		{
+			heapReleases.fetch_add(1, std::memory_order_relaxed);
+			::operator delete(block);
+		}
+
+		static inline thread_local ThreadCache threadCache;
+
+		static inline std::mutex parkedMutex;
+		static inline std::vector<Cache*> parked;
+
+		static inline std::atomic<uint64_t> heapAllocations = 0;
+		static inline std::atomic<uint64_t> heapReleases = 0;
+		static inline std::atomic<uint64_t> poolReuses = 0;
+		static inline std::atomic<uint64_t> crossThreadReleases = 0;
+	};
+
+	// Byte buffer for message bodies: up to inlineCapacity bytes live inside the object,
+	// anything larger comes from BodyPool. Unlike std::vector, resize() leaves new bytes uninitialised.
+	class MessageBody
+	{
+	public:
+		static constexpr size_t inlineCapacity = 128;
+
+		MessageBody() = default;
+
+		MessageBody(const MessageBody& other)
+		{
+			assign(other.data(), other.data() + other.size());
+		}
+
+		MessageBody(MessageBody&& other) noexcept
+		{
+			MoveFrom(other);
+		}
+
+		~MessageBody()
+		{
+			ReleaseHeap();
+		}
+
+		auto operator=(const MessageBody& other) -> MessageBody&
+		{
+			if (this != &other)
+				assign(other.data(), other.data() + other.size());
+			return *this;
+		}
+
+		auto operator=(MessageBody&& other) noexcept -> MessageBody&
+		{
+			if (this != &other)
+			{
+				ReleaseHeap();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+
+		auto data() -> uint8_t* { return heap ? heap : inlineData; }
+		auto data() const -> const uint8_t* { return heap ? heap : inlineData; }
+		auto begin() -> uint8_t* { return data(); }
+		auto begin() const -> const uint8_t* { return data(); }
+		auto end() -> uint8_t* { return data() + length; }
+		auto end() const -> const uint8_t* { return data() + length; }
+
+		auto size() const -> size_t { return length; }
+		auto capacity() const -> size_t { return heap ? heapCapacity : inlineCapacity; }
+		auto empty() const -> bool { return length == 0; }
+
+		auto reserve(size_t bytes) -> void
+		{
+			if (bytes <= capacity())
+				return;
+
+			size_t newCapacity = 0;
+			BodyPool::Cache* newOwner = nullptr;
+			uint8_t* block = BodyPool::Allocate(std::max(bytes, capacity() * 2), newCapacity, newOwner);
+			if (length > 0)
+				std::memcpy(block, data(), length);
+
+			ReleaseHeap();
+			heap = block;
+			heapCapacity = newCapacity;
+			owner = newOwner;
+		}
+
+		auto resize(size_t bytes) -> void
+		{
+			reserve(bytes);
+			length = bytes;
+		}
+
+		auto clear() -> void
+		{
+			length = 0;
+		}
+
+		auto assign(const uint8_t* first, const uint8_t* last) -> void
+		{
+			const size_t bytes = static_cast<size_t>(last - first);
+			if (bytes > capacity())
+			{
+				length = 0;
+				reserve(bytes);
+			}
+			if (bytes > 0)
+				std::memmove(data(), first, bytes);
+			length = bytes;
+		}
+
+	private:
+		auto ReleaseHeap() -> void
+		{
+			if (heap)
+				BodyPool::Release(heap, heapCapacity, owner);
+			heap = nullptr;
+			heapCapacity = 0;
+			owner = nullptr;
+		}
+
+		auto MoveFrom(MessageBody& other) -> void
+		{
+			if (other.heap)
+			{
+				heap = other.heap;
+				heapCapacity = other.heapCapacity;
+				owner = other.owner;
+				other.heap = nullptr;
+				other.heapCapacity = 0;
+				other.owner = nullptr;
+			}
+			else if (other.length > 0)
+			{
+				std::memcpy(inlineData, other.inlineData, other.length);
+			}
+			length = other.length;
+			other.length = 0;
+		}
+
+		uint8_t* heap = nullptr;
+		size_t heapCapacity = 0;
+		BodyPool::Cache* owner = nullptr;
+		size_t length = 0;
+		uint8_t inlineData[inlineCapacity];
+	};
+}
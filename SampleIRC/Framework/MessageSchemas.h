@@ -0,0 +1,189 @@
+#pragma once
+
+#include "MessageTypes.h"
+#include "Schema.h"
+
+// Wire layout of every IRCMessageType, encoded with IRC::Encode and read back with IRC::Decode.
+namespace Schema
+{
+	// `capabilities` is the set of IRC::Capability bits the server supports.
+	struct ServerAccept
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ServerAccept;
+
+		uint32_t clientID;
+		uint32_t capabilities;
+
+		static constexpr auto Fields() { return std::make_tuple(&ServerAccept::clientID, &ServerAccept::capabilities); }
+	};
+
+	struct ServerDeny
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ServerDeny;
+
+		static constexpr auto Fields() { return std::make_tuple(); }
+	};
+
+	// Echoed back unchanged by the server. Both times are the sender's steady clock: when the ping
+	// went out, and when it was meant to (the same unless the sender runs a fixed-rate schedule).
+	struct ServerPing
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ServerPing;
+
+		int64_t timestamp;
+		int64_t scheduled;
+
+		static constexpr auto Fields() { return std::make_tuple(&ServerPing::timestamp, &ServerPing::scheduled); }
+	};
+
+	struct MessageAll
+	{
+		static constexpr IRCMessageType id = IRCMessageType::MessageAll;
+
+		std::string_view text;
+
+		static constexpr auto Fields() { return std::make_tuple(&MessageAll::text); }
+	};
+
+	// `sequence` numbers the server's relays, from 1; a Replay asks for them again by number.
+	struct ServerMessage
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ServerMessage;
+
+		uint32_t senderID;
+		uint64_t sequence;
+		std::string_view text;
+
+		static constexpr auto Fields() { return std::make_tuple(&ServerMessage::senderID, &ServerMessage::sequence, &ServerMessage::text); }
+	};
+
+	struct JoinChannel
+	{
+		static constexpr IRCMessageType id = IRCMessageType::JoinChannel;
+
+		std::string_view channel;
+
+		static constexpr auto Fields() { return std::make_tuple(&JoinChannel::channel); }
+	};
+
+	struct PartChannel
+	{
+		static constexpr IRCMessageType id = IRCMessageType::PartChannel;
+
+		std::string_view channel;
+
+		static constexpr auto Fields() { return std::make_tuple(&PartChannel::channel); }
+	};
+
+	// Clients leave senderID and sequence at 0; the server fills them in before relaying to the
+	// channel's members. Each channel numbers its messages separately.
+	struct ChannelMessage
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ChannelMessage;
+
+		uint32_t senderID;
+		uint64_t sequence;
+		std::string_view channel;
+		std::string_view text;
+
+		static constexpr auto Fields() { return std::make_tuple(&ChannelMessage::senderID, &ChannelMessage::sequence, &ChannelMessage::channel, &ChannelMessage::text); }
+	};
+
+	// Sent with an empty report to ask for a snapshot; the server answers with the snapshot as JSON.
+	struct AdminMetrics
+	{
+		static constexpr IRCMessageType id = IRCMessageType::AdminMetrics;
+
+		std::string_view report;
+
+		static constexpr auto Fields() { return std::make_tuple(&AdminMetrics::report); }
+	};
+
+	// The client's answer to ServerAccept: the capabilities it wants, out of those offered. Optional;
+	// without it the connection uses none.
+	struct ClientHello
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ClientHello;
+
+		uint32_t capabilities;
+
+		static constexpr auto Fields() { return std::make_tuple(&ClientHello::capabilities); }
+	};
+
+	// Bulk data for a channel, such as a shared file, sent as a stream of these: each chunk is relayed
+	// to the channel's members as it arrives, with senderID filled in and the stream flags kept.
+	struct ChannelData
+	{
+		static constexpr IRCMessageType id = IRCMessageType::ChannelData;
+
+		uint32_t senderID;
+		std::string_view channel;
+		std::string_view data;
+
+		static constexpr auto Fields() { return std::make_tuple(&ChannelData::senderID, &ChannelData::channel, &ChannelData::data); }
+	};
+
+	// Asks for recent messages again: the server-wide ones with an empty channel, else the channel's.
+	// With `since` above 0, every message after that sequence number still kept; otherwise the last
+	// `count`. The server resends the stored frames as they were, then this message back with `count`
+	// set to how many it sent and `since` to the latest sequence number. Messages relayed while a
+	// replay is under way can arrive twice; clients drop numbers they have already seen. Server-wide
+	// messages older than the kept ones come from the server's journal, if it has one, up to a limit
+	// per request; the client asks again from the last number it got.
+	struct Replay
+	{
+		static constexpr IRCMessageType id = IRCMessageType::Replay;
+
+		std::string_view channel;
+		uint32_t count;
+		uint64_t since;
+
+		static constexpr auto Fields() { return std::make_tuple(&Replay::channel, &Replay::count, &Replay::since); }
+	};
+
+	// Turns a connection between two servers into a link. The connecting server sends it once
+	// accepted and the other answers with its own. `node` names a server and must be unique in the
+	// network; `epoch` tells one run of it from the next, since its numbering starts over. `secret`
+	// is the network's shared link secret, without which the other server refuses the link.
+	struct LinkHello
+	{
+		static constexpr IRCMessageType id = IRCMessageType::LinkHello;
+
+		uint32_t node;
+		uint64_t epoch;
+		std::string_view secret;
+
+		static constexpr auto Fields() { return std::make_tuple(&LinkHello::node, &LinkHello::epoch, &LinkHello::secret); }
+	};
+
+	// A server-wide message on its way across links, numbered by the server its sender is on. Not a
+	// message of its own: LinkBatch carries these back to back.
+	struct LinkRelay
+	{
+		uint32_t origin;
+		uint64_t epoch;
+		uint64_t sequence;
+		uint32_t senderID;
+		std::string_view text;
+
+		static constexpr auto Fields() { return std::make_tuple(&LinkRelay::origin, &LinkRelay::epoch, &LinkRelay::sequence, &LinkRelay::senderID, &LinkRelay::text); }
+	};
+
+	// `count` LinkRelay records, written with IRC::EncodeInto and read back with IRC::DecodeFrom.
+	struct LinkBatch
+	{
+		static constexpr IRCMessageType id = IRCMessageType::LinkBatch;
+
+		uint32_t count;
+		std::span<const uint8_t> records;
+
+		static constexpr auto Fields() { return std::make_tuple(&LinkBatch::count, &LinkBatch::records); }
+	};
+
+	static_assert(IRC::FixedWireSize<ServerAccept> == 2 * sizeof(uint32_t));
+	static_assert(IRC::FixedWireSize<ClientHello> == sizeof(uint32_t));
+	static_assert(IRC::FixedWireSize<ServerDeny> == 0);
+	static_assert(IRC::FixedWireSize<ServerPing> == 2 * sizeof(int64_t));
+	static_assert(IRC::FixedWireSize<ServerMessage> == 2 * sizeof(uint32_t) + sizeof(uint64_t));
+	static_assert(IRC::FixedWireSize<LinkHello> == 2 * sizeof(uint32_t) + sizeof(uint64_t));
+}
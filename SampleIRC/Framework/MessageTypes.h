@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 
 enum class IRCMessageType : uint32_t
 {
@@ -9,4 +10,16 @@ enum class IRCMessageType : uint32_t
 	ServerPing,
 	MessageAll,
 	ServerMessage,
-};
\ No newline at end of file
+	JoinChannel,
+	PartChannel,
+	ChannelMessage,
+	AdminMetrics,
+	ClientHello,
+	ChannelData,
+	Replay,
+	LinkHello,
+	LinkBatch,
+};
+
+// Keep in step with the last type above; sizes the server's handler table.
+constexpr size_t IRCMessageTypeCount = static_cast<size_t>(IRCMessageType::LinkBatch) + 1;
\ No newline at end of file
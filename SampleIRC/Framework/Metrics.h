@@ -0,0 +1,303 @@
+#pragma once
+
+#include "Common.h"
+
+#include <bit>
+#include <cstdio>
+
+namespace IRC
+{
+	// Log-linear histogram in the style of HdrHistogram: values below 2^subBucketBits are counted
+	// exactly, every power of two above that is split into 2^subBucketBits equal buckets, so any
+	// recorded value is reported to within ~3%. Recording is a single relaxed increment and may be
+	// done from any thread.
+	class Histogram
+	{
+	public:
+		static constexpr uint32_t subBucketBits = 5;
+		static constexpr uint32_t subBuckets = 1u << subBucketBits;
+		static constexpr size_t bucketCount = subBuckets + (64 - subBucketBits) * subBuckets;
+
+		struct Summary
+		{
+			uint64_t count = 0;
+			uint64_t min = 0;
+			uint64_t max = 0;
+			double mean = 0.0;
+			uint64_t p50 = 0;
+			uint64_t p90 = 0;
+			uint64_t p99 = 0;
+			uint64_t p999 = 0;
+		};
+
+		auto Record(uint64_t value) -> void
+		{
+			counts[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+			total.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		// Adds the other histogram's records to this one; the other may still be recording.
+		auto Merge(const Histogram& other) -> void
+		{
+			for (size_t bucket = 0; bucket < bucketCount; bucket++)
+				counts[bucket].fetch_add(other.counts[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			total.fetch_add(other.total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		auto Reset() -> void
+		{
+			for (auto& count : counts)
+				count.store(0, std::memory_order_relaxed);
+			total.store(0, std::memory_order_relaxed);
+		}
+
+		// Reads the buckets without stopping writers, so the result may be a few records stale.
+		auto Summarize() const -> Summary
+		{
+			std::vector<uint64_t> snapshot(bucketCount);
+			Summary summary;
+			for (size_t bucket = 0; bucket < bucketCount; bucket++)
+			{
+				snapshot[bucket] = counts[bucket].load(std::memory_order_relaxed);
+				summary.count += snapshot[bucket];
+			}
+
+			if (summary.count == 0)
+				return summary;
+
+			summary.mean = static_cast<double>(total.load(std::memory_order_relaxed)) / summary.count;
+			summary.min = LowestOf(FirstBucket(snapshot));
+			summary.max = HighestOf(LastBucket(snapshot));
+			summary.p50 = Percentile(snapshot, summary.count, 0.50);
+			summary.p90 = Percentile(snapshot, summary.count, 0.90);
+			summary.p99 = Percentile(snapshot, summary.count, 0.99);
+			summary.p999 = Percentile(snapshot, summary.count, 0.999);
+			return summary;
+		}
+
+		static constexpr auto BucketOf(uint64_t value) -> size_t
+		{
+			if (value < subBuckets)
+				return static_cast<size_t>(value);
+
+			const uint32_t magnitude = static_cast<uint32_t>(std::bit_width(value)) - 1;
+			const uint32_t shift = magnitude - subBucketBits;
+			return subBuckets + shift * subBuckets + static_cast<size_t>((value >> shift) - subBuckets);
+		}
+
+		static constexpr auto LowestOf(size_t bucket) -> uint64_t
+		{
+			if (bucket < subBuckets)
+				return bucket;
+
+			const uint64_t shift = (bucket - subBuckets) / subBuckets;
+			const uint64_t sub = (bucket - subBuckets) % subBuckets;
+			return (subBuckets + sub) << shift;
+		}
+
+		static constexpr auto HighestOf(size_t bucket) -> uint64_t
+		{
+			return bucket + 1 < bucketCount ? LowestOf(bucket + 1) - 1 : UINT64_MAX;
+		}
+
+	private:
+		static auto FirstBucket(const std::vector<uint64_t>& snapshot) -> size_t
+		{
+			size_t bucket = 0;
+			while (snapshot[bucket] == 0)
+				bucket++;
+			return bucket;
+		}
+
+		static auto LastBucket(const std::vector<uint64_t>& snapshot) -> size_t
+		{
+			size_t bucket = snapshot.size() - 1;
+			while (snapshot[bucket] == 0)
+				bucket--;
+			return bucket;
+		}
+
+		// Upper edge of the bucket holding the q-th recorded value.
+		static auto Percentile(const std::vector<uint64_t>& snapshot, uint64_t count, double q) -> uint64_t
+		{
+			const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+			uint64_t seen = 0;
+			for (size_t bucket = 0; bucket < snapshot.size(); bucket++)
+			{
+				seen += snapshot[bucket];
+				if (seen >= rank)
+					return HighestOf(bucket);
+			}
+			return HighestOf(snapshot.size() - 1);
+		}
+
+		std::array<std::atomic<uint64_t>, bucketCount> counts{};
+		std::atomic<uint64_t> total = 0;
+	};
+
+	static_assert(Histogram::BucketOf(31) == 31 && Histogram::BucketOf(32) == 32 && Histogram::BucketOf(64) == 64);
+	static_assert(Histogram::LowestOf(Histogram::BucketOf(1000)) <= 1000 && Histogram::HighestOf(Histogram::BucketOf(1000)) >= 1000);
+	static_assert(Histogram::BucketOf(UINT64_MAX) == Histogram::bucketCount - 1);
+
+	// Traffic totals for one shard. Every connection on the shard adds to the same instance from
+	// the shard's thread, so the counters stay on one core's cache lines.
+	struct alignas(64) TrafficCounters
+	{
+		std::atomic<uint64_t> bytesIn = 0;
+		std::atomic<uint64_t> messagesIn = 0;
+		std::atomic<uint64_t> bytesOut = 0;
+		std::atomic<uint64_t> messagesOut = 0;
+		std::atomic<int64_t> outQueueMessages = 0;
+		std::atomic<int64_t> outQueueBytes = 0;
+		std::atomic<uint64_t> droppedMessages = 0;
+		std::atomic<uint64_t> slowConsumerDisconnects = 0;
+		std::atomic<uint64_t> heartbeatsSent = 0;
+		std::atomic<uint64_t> idleDisconnects = 0;
+	};
+
+	struct MetricsSnapshot
+	{
+		double uptimeSeconds = 0.0;
+
+		uint64_t connectionsAccepted = 0;
+		uint64_t connectionsDenied = 0;
+		uint64_t acceptErrors = 0;
+		uint64_t connectionsReaped = 0;
+		uint64_t activeConnections = 0;
+
+		uint64_t bytesIn = 0;
+		uint64_t messagesIn = 0;
+		uint64_t bytesOut = 0;
+		uint64_t messagesOut = 0;
+		uint64_t messagesHandled = 0;
+		uint64_t inboundQueueDepth = 0;
+		int64_t outQueueMessages = 0;
+		int64_t outQueueBytes = 0;
+		uint64_t droppedMessages = 0;
+		uint64_t slowConsumerDisconnects = 0;
+		uint64_t heartbeatsSent = 0;
+		uint64_t idleDisconnects = 0;
+
+		// Filled in by servers that keep an IRC::ReplayHistory.
+		uint64_t replayMessages = 0;
+		uint64_t replayBytes = 0;
+		uint64_t replayEvicted = 0;
+
+		// Filled in by servers that keep an IRC::Journal.
+		uint64_t journalRecords = 0;
+		uint64_t journalBytes = 0;
+		uint64_t journalSyncs = 0;
+		uint64_t journalSyncFailures = 0;
+		uint64_t journalUnsynced = 0;
+
+		// Filled in by servers linked to others: relays are the server-wide messages crossing links.
+		uint64_t federationLinks = 0;
+		uint64_t linkBatchesSent = 0;
+		uint64_t linkRelaysSent = 0;
+		uint64_t linkRelaysReceived = 0;
+		uint64_t linkDuplicates = 0;
+
+		// Nanoseconds.
+		Histogram::Summary inboundWait;
+		Histogram::Summary handlerTime;
+	};
+
+	enum class MetricsFormat
+	{
+		text,
+		json
+	};
+
+	// Counts with `previous` also get per-second rates over the time between the two snapshots.
+	inline auto FormatMetrics(const MetricsSnapshot& now, const MetricsSnapshot* previous, MetricsFormat format) -> std::string
+	{
+		std::string out;
+		const bool json = format == MetricsFormat::json;
+		bool first = true;
+
+		auto append = [&out](const char* pattern, auto... values)
+			{
+				char line[160];
+				const int length = std::snprintf(line, sizeof(line), pattern, values...);
+				out.append(line, static_cast<size_t>(std::clamp(length, 0, static_cast<int>(sizeof(line)) - 1)));
+			};
+
+		auto field = [&](const char* name, auto value)
+			{
+				const char* separator = first ? "" : ",";
+				first = false;
+				if constexpr (std::is_floating_point_v<decltype(value)>)
+					json ? append("%s\"%s\":%.3f", separator, name, value) : append("%s %.3f\n", name, value);
+				else if constexpr (std::is_signed_v<decltype(value)>)
+					json ? append("%s\"%s\":%lld", separator, name, static_cast<long long>(value)) : append("%s %lld\n", name, static_cast<long long>(value));
+				else
+					json ? append("%s\"%s\":%llu", separator, name, static_cast<unsigned long long>(value)) : append("%s %llu\n", name, static_cast<unsigned long long>(value));
+			};
+
+		auto counter = [&](const char* name, uint64_t value, uint64_t before)
+			{
+				field(name, value);
+				if (previous && now.uptimeSeconds > previous->uptimeSeconds)
+				{
+					const std::string rate = std::string(name) + "_per_sec";
+					field(rate.c_str(), static_cast<double>(value - before) / (now.uptimeSeconds - previous->uptimeSeconds));
+				}
+			};
+
+		auto histogram = [&](const std::string& name, const Histogram::Summary& summary)
+			{
+				field((name + "_count").c_str(), summary.count);
+				field((name + "_min_ns").c_str(), summary.min);
+				field((name + "_mean_ns").c_str(), summary.mean);
+				field((name + "_p50_ns").c_str(), summary.p50);
+				field((name + "_p90_ns").c_str(), summary.p90);
+				field((name + "_p99_ns").c_str(), summary.p99);
+				field((name + "_p999_ns").c_str(), summary.p999);
+				field((name + "_max_ns").c_str(), summary.max);
+			};
+
+		const MetricsSnapshot zero;
+		const MetricsSnapshot& before = previous ? *previous : zero;
+
+		if (json)
+			out += '{';
+
+		field("uptime_sec", now.uptimeSeconds);
+		counter("connections_accepted", now.connectionsAccepted, before.connectionsAccepted);
+		counter("connections_denied", now.connectionsDenied, before.connectionsDenied);
+		counter("accept_errors", now.acceptErrors, before.acceptErrors);
+		counter("connections_reaped", now.connectionsReaped, before.connectionsReaped);
+		field("connections_active", now.activeConnections);
+		counter("bytes_in", now.bytesIn, before.bytesIn);
+		counter("messages_in", now.messagesIn, before.messagesIn);
+		counter("bytes_out", now.bytesOut, before.bytesOut);
+		counter("messages_out", now.messagesOut, before.messagesOut);
+		counter("messages_handled", now.messagesHandled, before.messagesHandled);
+		field("inbound_queue_depth", now.inboundQueueDepth);
+		field("out_queue_messages", now.outQueueMessages);
+		field("out_queue_bytes", now.outQueueBytes);
+		counter("dropped_messages", now.droppedMessages, before.droppedMessages);
+		counter("slow_consumer_disconnects", now.slowConsumerDisconnects, before.slowConsumerDisconnects);
+		counter("heartbeats_sent", now.heartbeatsSent, before.heartbeatsSent);
+		counter("idle_disconnects", now.idleDisconnects, before.idleDisconnects);
+		field("replay_messages", now.replayMessages);
+		field("replay_bytes", now.replayBytes);
+		counter("replay_evicted", now.replayEvicted, before.replayEvicted);
+		counter("journal_records", now.journalRecords, before.journalRecords);
+		counter("journal_bytes", now.journalBytes, before.journalBytes);
+		counter("journal_syncs", now.journalSyncs, before.journalSyncs);
+		counter("journal_sync_failures", now.journalSyncFailures, before.journalSyncFailures);
+		field("journal_unsynced", now.journalUnsynced);
+		field("federation_links", now.federationLinks);
+		counter("link_batches_sent", now.linkBatchesSent, before.linkBatchesSent);
+		counter("link_relays_sent", now.linkRelaysSent, before.linkRelaysSent);
+		counter("link_relays_received", now.linkRelaysReceived, before.linkRelaysReceived);
+		counter("link_duplicates", now.linkDuplicates, before.linkDuplicates);
+		histogram("inbound_wait", now.inboundWait);
+		histogram("handler_time", now.handlerTime);
+
+		if (json)
+			out += "}\n";
+		return out;
+	}
+}
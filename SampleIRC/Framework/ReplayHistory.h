@@ -0,0 +1,195 @@
+#pragma once
+
+#include "Common.h"
+#include "Message.h"
+
+namespace IRC
+{
+	// Recent traffic per room, kept as the encoded frames that were relayed, so a replay sends the
+	// very same shared bytes without encoding anything again. Each room numbers its messages from 1
+	// and keeps its last messagesPerRoom; all rooms together keep at most maxBytes, the oldest message
+	// of any room going first. Not thread-safe, except for GetStats.
+	template<typename T>
+	class ReplayHistory
+	{
+	public:
+		using RoomID = uint32_t;
+
+		struct Limits
+		{
+			size_t messagesPerRoom = 256;
+			size_t maxBytes = 16 * 1024 * 1024;
+		};
+
+		struct Stats
+		{
+			uint64_t messages = 0;
+			uint64_t bytes = 0;
+			uint64_t evicted = 0;
+		};
+
+		explicit ReplayHistory(Limits limits = {})
+			: limits(limits)
+		{ }
+
+		// The sequence number the next message appended to the room will get.
+		auto NextSequence(RoomID room) const -> uint64_t
+		{
+			return room < rooms.size() ? rooms[room].nextSequence : 1;
+		}
+
+		// Oldest sequence number the room still keeps, or NextSequence(room) when it keeps none.
+		auto OldestSequence(RoomID room) const -> uint64_t
+		{
+			if (room >= rooms.size() || rooms[room].entries.empty())
+				return NextSequence(room);
+			return rooms[room].entries.front().sequence;
+		}
+
+		// Carries a room's numbering on from `nextSequence`, as after a restart; only while it is empty.
+		auto ResumeAt(RoomID room, uint64_t nextSequence) -> void
+		{
+			if (room >= rooms.size())
+				rooms.resize(room + 1);
+			if (rooms[room].entries.empty())
+				rooms[room].nextSequence = std::max(rooms[room].nextSequence, nextSequence);
+		}
+
+		// Lets go of everything the room keeps, as when the room itself goes away. Its numbering carries
+		// on, so a room ID that is reused never hands out a number it had before.
+		auto Clear(RoomID room) -> void
+		{
+			if (room >= rooms.size())
+				return;
+
+			while (!rooms[room].entries.empty())
+				EvictOldest(rooms[room]);
+		}
+
+		// Keeps msg as the room's message number NextSequence(room), evicting whatever goes over the
+		// limits; returns that number.
+		auto Append(RoomID room, IRC::SharedMessage<T> msg) -> uint64_t
+		{
+			if (room >= rooms.size())
+				rooms.resize(room + 1);
+
+			Room& target = rooms[room];
+			const uint64_t sequence = target.nextSequence++;
+			const size_t size = msg->size();
+			target.entries.push_back({ sequence, std::move(msg) });
+			order.push_back({ room, sequence });
+			Account(1, static_cast<int64_t>(size));
+
+			if (target.entries.size() > limits.messagesPerRoom)
+			{
+				EvictOldest(target);
+				if (order.size() > 2 * messages.load(std::memory_order_relaxed) + slackPositions)
+					DropStalePositions();
+			}
+			while (bytes.load(std::memory_order_relaxed) > limits.maxBytes && !order.empty())
+				EvictOldestOverall();
+
+			return sequence;
+		}
+
+		// Calls visit(sequence, msg) for the room's last `count` messages, oldest first.
+		template<typename Visit>
+		auto Last(RoomID room, size_t count, Visit&& visit) const -> size_t
+		{
+			if (room >= rooms.size())
+				return 0;
+
+			const auto& entries = rooms[room].entries;
+			const size_t first = entries.size() - std::min(count, entries.size());
+			for (size_t index = first; index < entries.size(); index++)
+				visit(entries[index].sequence, entries[index].msg);
+			return entries.size() - first;
+		}
+
+		// Calls visit(sequence, msg) for every message still kept after `sequence`, oldest first.
+		// Sequence numbers in a room have no gaps, so the first one is found without a search.
+		template<typename Visit>
+		auto Since(RoomID room, uint64_t sequence, Visit&& visit) const -> size_t
+		{
+			if (room >= rooms.size() || rooms[room].entries.empty())
+				return 0;
+
+			const auto& entries = rooms[room].entries;
+			const uint64_t oldest = entries.front().sequence;
+			const size_t first = sequence < oldest ? 0 : static_cast<size_t>(std::min<uint64_t>(sequence + 1 - oldest, entries.size()));
+			for (size_t index = first; index < entries.size(); index++)
+				visit(entries[index].sequence, entries[index].msg);
+			return entries.size() - first;
+		}
+
+		auto GetStats() const -> Stats
+		{
+			return { messages.load(std::memory_order_relaxed),
+					 bytes.load(std::memory_order_relaxed),
+					 evicted.load(std::memory_order_relaxed) };
+		}
+
+	private:
+		struct Entry
+		{
+			uint64_t sequence;
+			IRC::SharedMessage<T> msg;
+		};
+
+		struct Room
+		{
+			std::deque<Entry> entries;
+			uint64_t nextSequence = 1;
+		};
+
+		struct Position
+		{
+			RoomID room;
+			uint64_t sequence;
+		};
+
+		// `order` still holds the message's position; it is skipped once it reaches the front, or
+		// dropped when stale positions come to outnumber live ones.
+		auto EvictOldest(Room& room) -> void
+		{
+			Account(-1, -static_cast<int64_t>(room.entries.front().msg->size()));
+			room.entries.pop_front();
+			evicted.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		auto EvictOldestOverall() -> void
+		{
+			const Position oldest = order.front();
+			order.pop_front();
+
+			Room& room = rooms[oldest.room];
+			if (!room.entries.empty() && room.entries.front().sequence == oldest.sequence)
+				EvictOldest(room);
+		}
+
+		auto DropStalePositions() -> void
+		{
+			std::erase_if(order, [this](const Position& position)
+				{
+					const auto& entries = rooms[position.room].entries;
+					return entries.empty() || position.sequence < entries.front().sequence;
+				});
+		}
+
+		auto Account(int64_t count, int64_t size) -> void
+		{
+			messages.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+			bytes.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+		}
+
+		static constexpr size_t slackPositions = 1024;
+
+		Limits limits;
+		std::vector<Room> rooms;
+		std::deque<Position> order;
+
+		std::atomic<uint64_t> messages = 0;
+		std::atomic<uint64_t> bytes = 0;
+		std::atomic<uint64_t> evicted = 0;
+	};
+}
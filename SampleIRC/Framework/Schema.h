@@ -0,0 +1,185 @@
+#pragma once
+
+#include "Common.h"
+#include "Message.h"
+
+#include <span>
+#include <string_view>
+#include <tuple>
+
+namespace IRC
+{
+	// How a single schema field is laid out on the wire. Trivially copyable values are stored as-is;
+	// strings and byte spans are stored as a uint32_t length followed by the bytes, and are read back
+	// as views into the message body.
+	template<typename FieldType>
+	struct FieldCodec
+	{
+		static_assert(std::is_trivially_copyable_v<FieldType>, "Field type has no wire encoding");
+
+		static constexpr bool fixedSize = true;
+		static constexpr size_t wireSize = sizeof(FieldType);
+
+		static constexpr auto Size(const FieldType&) -> size_t
+		{
+			return wireSize;
+		}
+
+		static auto Write(uint8_t*& out, const FieldType& value) -> void
+		{
+			std::memcpy(out, &value, sizeof(FieldType));
+			out += sizeof(FieldType);
+		}
+
+		static auto Read(const uint8_t*& in, const uint8_t* end, FieldType& value) -> bool
+		{
+			if (static_cast<size_t>(end - in) < sizeof(FieldType))
+				return false;
+
+			std::memcpy(&value, in, sizeof(FieldType));
+			in += sizeof(FieldType);
+			return true;
+		}
+	};
+
+	template<typename ViewType>
+	struct LengthPrefixedCodec
+	{
+		using Element = typename ViewType::value_type;
+
+		static constexpr bool fixedSize = false;
+		static constexpr size_t wireSize = sizeof(uint32_t);
+
+		static auto Size(const ViewType& value) -> size_t
+		{
+			return wireSize + value.size() * sizeof(Element);
+		}
+
+		static auto Write(uint8_t*& out, const ViewType& value) -> void
+		{
+			const uint32_t length = static_cast<uint32_t>(value.size());
+			std::memcpy(out, &length, sizeof(length));
+			out += sizeof(length);
+			if (length > 0)
+				std::memcpy(out, value.data(), length * sizeof(Element));
+			out += length * sizeof(Element);
+		}
+
+		static auto Read(const uint8_t*& in, const uint8_t* end, ViewType& value) -> bool
+		{
+			uint32_t length = 0;
+			if (static_cast<size_t>(end - in) < sizeof(length))
+				return false;
+
+			std::memcpy(&length, in, sizeof(length));
+			in += sizeof(length);
+			if (static_cast<size_t>(end - in) < length * sizeof(Element))
+				return false;
+
+			value = ViewType(reinterpret_cast<const Element*>(in), length);
+			in += length * sizeof(Element);
+			return true;
+		}
+	};
+
+	template<>
+	struct FieldCodec<std::string_view> : LengthPrefixedCodec<std::string_view> { };
+
+	template<>
+	struct FieldCodec<std::span<const uint8_t>> : LengthPrefixedCodec<std::span<const uint8_t>> { };
+
+	template<typename MemberPointer>
+	struct MemberOf;
+
+	template<typename Class, typename Member>
+	struct MemberOf<Member Class::*>
+	{
+		using type = Member;
+	};
+
+	template<typename MemberPointer>
+	using CodecFor = FieldCodec<typename MemberOf<MemberPointer>::type>;
+
+	// A schema is a struct with a static constexpr `id` and a static constexpr Fields() returning
+	// a tuple of member pointers in wire order.
+	template<typename Schema>
+	constexpr bool IsFixedSize = std::apply(
+		[](auto... members) { return (true && ... && CodecFor<decltype(members)>::fixedSize); },
+		Schema::Fields());
+
+	// Exact size for fixed-size schemas; the size without the variable-length payloads otherwise.
+	template<typename Schema>
+	constexpr size_t FixedWireSize = std::apply(
+		[](auto... members) { return (size_t(0) + ... + CodecFor<decltype(members)>::wireSize); },
+		Schema::Fields());
+
+	template<typename Schema>
+	auto WireSize(const Schema& schema) -> size_t
+	{
+		if constexpr (IsFixedSize<Schema>)
+		{
+			return FixedWireSize<Schema>;
+		}
+		else
+		{
+			return std::apply(
+				[&schema](auto... members) { return (size_t(0) + ... + CodecFor<decltype(members)>::Size(schema.*members)); },
+				Schema::Fields());
+		}
+	}
+
+	// Single pass: the body is sized exactly once and the fields are written front to back.
+	template<typename Schema>
+	auto Encode(const Schema& schema) -> IRC::Message<std::remove_const_t<decltype(Schema::id)>>
+	{
+		IRC::Message<std::remove_const_t<decltype(Schema::id)>> msg;
+		msg.header.id = Schema::id;
+		msg.body.resize(WireSize(schema));
+
+		uint8_t* out = msg.body.data();
+		std::apply(
+			[&schema, &out](auto... members) { (CodecFor<decltype(members)>::Write(out, schema.*members), ...); },
+			Schema::Fields());
+
+		msg.header.size = static_cast<uint32_t>(msg.body.size());
+		return msg;
+	}
+
+	// Appends the fields to `out` laid out as Encode lays out a body, for records packed back to back
+	// into a single field of another message. The schema needs no `id`.
+	template<typename Schema>
+	auto EncodeInto(std::vector<uint8_t>& out, const Schema& schema) -> void
+	{
+		const size_t offset = out.size();
+		out.resize(offset + WireSize(schema));
+
+		uint8_t* write = out.data() + offset;
+		std::apply(
+			[&schema, &write](auto... members) { (CodecFor<decltype(members)>::Write(write, schema.*members), ...); },
+			Schema::Fields());
+	}
+
+	// Reads one schema's fields from `in`, leaving it just past them. Returns nothing, with `in` left
+	// anywhere up to `end`, if the bytes run out.
+	template<typename Schema>
+	auto DecodeFrom(const uint8_t*& in, const uint8_t* end) -> std::optional<Schema>
+	{
+		Schema schema{};
+		const bool complete = std::apply(
+			[&schema, &in, end](auto... members) { return (true && ... && CodecFor<decltype(members)>::Read(in, end, schema.*members)); },
+			Schema::Fields());
+
+		if (!complete)
+			return std::nullopt;
+		return schema;
+	}
+
+	// Reads the fields front to back. Strings and spans point into msg.body, so the result must not
+	// outlive the message. Returns nothing if the body is too short for the schema.
+	template<typename Schema, typename T>
+	auto Decode(const IRC::Message<T>& msg) -> std::optional<Schema>
+	{
+		const uint8_t* in = msg.body.data();
+		return DecodeFrom<Schema>(in, in + msg.body.size());
+	}
+}
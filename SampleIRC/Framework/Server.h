@@ -2,8 +2,14 @@
 
 #include "Common.h"
 #include "ThreadSafeQueue.h"
+#include "MPSCQueue.h"
 #include "Message.h"
 #include "Connection.h"
+#include "HandlerTable.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "SlotMap.h"
+#include "TimerWheel.h"
 
 namespace IRC
 {
@@ -11,10 +17,21 @@ namespace IRC
 	class IServer
 	{
 	public:
-		IServer(uint16_t port)
-			: asioAcceptor(asioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
-		{ }
+		// Each shard owns an io_context, a thread, an acceptor and the connections accepted on it.
+		// With shardCount > 1 the shard threads are pinned to consecutive cores.
+		IServer(uint16_t port, uint32_t shardCount = 1)
+			: port(port)
+		{
+			shardCount = std::max<uint32_t>(shardCount, 1);
+			for (uint32_t index = 0; index < shardCount; index++)
+				shards.push_back(std::make_unique<Shard>(index, shardCount));
+
+			OpenAcceptors();
+		}
 
+		// By now a derived server's members are gone, while its handlers may still be running on the
+		// shard and worker threads; a derived server with state of its own calls Stop() in its own
+		// destructor. This one only catches servers that have none.
 		virtual ~IServer()
 		{
 			Stop();
@@ -24,66 +41,320 @@ namespace IRC
 		{
 			try
 			{
-				WaitForClientConnection();
+				for (auto& shard : shards)
+				{
+					if (shard->acceptor.is_open())
+						WaitForClientConnection(*shard);
+				}
+
+				if (heartbeatIntervalTicks > 0)
+				{
+					heartbeatStart = std::chrono::steady_clock::now();
+					for (auto& shard : shards)
+						ScheduleHeartbeatTick(*shard);
+				}
+
+				const bool pinThreads = shards.size() > 1;
+				for (auto& shard : shards)
+				{
+					Shard* pShard = shard.get();
+					shard->thread = std::thread([pShard, pinThreads]()
+						{
+							if (pinThreads)
+								PinCurrentThread(pShard->index);
+							pShard->context.run();
+						});
+				}
 
-				contextThread = std::thread([this]() { asioContext.run(); });
+				for (auto& worker : handlerWorkers)
+				{
+					HandlerWorker* pWorker = worker.get();
+					worker->thread = std::thread([this, pWorker]() { RunHandlerWorker(*pWorker); });
+				}
 			}
 			catch (std::exception& e)
 			{
-				std::cerr << "[Server] Exception: " << e.what() << "\n";
+				IRC::Log::Error("[Server] Exception: {}", e.what());
 				return false;
 			}
 
-			std::cout << "[Server] Started!\n";
+			IRC::Log::Info("[Server] Started with {} shard(s)!", shards.size());
 			return true;
 		}
 
+		// Joins the shard and handler threads; calling it again does nothing.
 		void Stop()
 		{
-			asioContext.stop();
+			if (stopped.exchange(true))
+				return;
+
+			for (auto& shard : shards)
+				shard->context.stop();
+
+			for (auto& shard : shards)
+			{
+				if (shard->thread.joinable()) shard->thread.join();
+			}
 
-			if (contextThread.joinable()) contextThread.join();
+			// An empty message wakes each worker so it can see the stop flag.
+			handlerWorkersRunning = false;
+			for (auto& worker : handlerWorkers)
+			{
+				worker->queue.push_back({});
+				if (worker->thread.joinable()) worker->thread.join();
+			}
+
+			IRC::Log::Info("[Server] Stopped!");
+		}
 
-			std::cout << "[Server] Stopped!\n";
+		auto ShardCount() const -> uint32_t
+		{
+			return static_cast<uint32_t>(shards.size());
 		}
 
+		// Applies to connections accepted afterwards; set it before Start().
+		auto SetOutQueueLimits(const IRC::OutQueueLimits<T>& limits) -> void
+		{
+			outQueueLimits = limits;
+		}
+
+		// Largest frame body a client may send; see Connection::SetMaxFrameSize. Set it before Start().
+		auto SetMaxFrameSize(size_t bytes) -> void
+		{
+			maxFrameSize = bytes;
+		}
+
+		// A connection that has sent nothing for `interval` gets a heartbeat frame, which the client's
+		// Connection answers on its own; one that stays silent for `idleTimeout` is closed and reaped.
+		// Each shard checks its connections from one timer wheel ticking at interval / 8, so a tick
+		// costs the same however many connections there are, and a busy connection is looked at once
+		// per interval rather than on every message. Set it before Start(); a zero interval turns it off.
+		auto SetHeartbeat(std::chrono::milliseconds interval, std::chrono::milliseconds idleTimeout) -> void
+		{
+			heartbeatTick = std::max(std::chrono::milliseconds(1), interval / 8);
+			auto toTicks = [this](std::chrono::milliseconds duration)
+				{
+					return static_cast<uint64_t>((duration + heartbeatTick - std::chrono::milliseconds(1)) / heartbeatTick);
+				};
+
+			heartbeatIntervalTicks = interval.count() > 0 ? toTicks(interval) : 0;
+			idleTimeoutTicks = std::max(heartbeatIntervalTicks, toTicks(idleTimeout));
+		}
+
+		// Routes messages through Owner's compile-time handler table instead of OnMessage. Types with no
+		// route still go to OnMessage. Call from the derived class's constructor.
+		template<typename Owner, const auto& table>
+		auto UseHandlerTable() -> void
+		{
+			dispatcher = [](IServer& server, IRC::IdentifyingMessage<T>& incoming, IRC::Dispatch from)
+				{
+					return IRC::DispatchMessage<table>(static_cast<Owner&>(server), incoming, from);
+				};
+		}
+
+		// Runs the Dispatch::onShard routes on the connection's shard thread, skipping the inbound
+		// queue and the hop to Update. Those handlers run concurrently across shards and are not
+		// ordered against queued messages. Applies to connections accepted afterwards.
+		auto SetInlineDispatch(bool enabled) -> void
+		{
+			inlineDispatch = enabled;
+		}
+
+		// Hands messages to `count` handler threads instead of the thread calling Update. Each
+		// connection always maps to the same worker, so its messages are handled one at a time and in
+		// order; messages from different connections run in parallel. Set it before Start().
+		auto SetHandlerWorkers(size_t count) -> void
+		{
+			handlerWorkers.clear();
+			for (size_t index = 0; index < count; index++)
+				handlerWorkers.push_back(std::make_unique<HandlerWorker>());
+		}
+
+		// Safe to call from any thread; nothing is locked or paused to take it.
+		auto GetMetrics() -> IRC::MetricsSnapshot
+		{
+			IRC::MetricsSnapshot snapshot;
+			snapshot.uptimeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+			snapshot.connectionsAccepted = connectionsAccepted.load(std::memory_order_relaxed);
+			snapshot.connectionsDenied = connectionsDenied.load(std::memory_order_relaxed);
+			snapshot.acceptErrors = acceptErrors.load(std::memory_order_relaxed);
+			snapshot.connectionsReaped = connectionsReaped.load(std::memory_order_relaxed);
+			snapshot.activeConnections = snapshot.connectionsAccepted - std::min(snapshot.connectionsReaped, snapshot.connectionsAccepted);
+			snapshot.messagesHandled = messagesHandled.load(std::memory_order_relaxed);
+			snapshot.inboundQueueDepth = inQueue.count();
+			for (auto& worker : handlerWorkers)
+				snapshot.inboundQueueDepth += worker->queue.count();
+
+			for (auto& shard : shards)
+			{
+				const IRC::TrafficCounters& traffic = shard->traffic;
+				snapshot.bytesIn += traffic.bytesIn.load(std::memory_order_relaxed);
+				snapshot.messagesIn += traffic.messagesIn.load(std::memory_order_relaxed);
+				snapshot.bytesOut += traffic.bytesOut.load(std::memory_order_relaxed);
+				snapshot.messagesOut += traffic.messagesOut.load(std::memory_order_relaxed);
+				snapshot.outQueueMessages += traffic.outQueueMessages.load(std::memory_order_relaxed);
+				snapshot.outQueueBytes += traffic.outQueueBytes.load(std::memory_order_relaxed);
+				snapshot.droppedMessages += traffic.droppedMessages.load(std::memory_order_relaxed);
+				snapshot.slowConsumerDisconnects += traffic.slowConsumerDisconnects.load(std::memory_order_relaxed);
+				snapshot.heartbeatsSent += traffic.heartbeatsSent.load(std::memory_order_relaxed);
+				snapshot.idleDisconnects += traffic.idleDisconnects.load(std::memory_order_relaxed);
+			}
+
+			snapshot.inboundWait = inboundWait.Summarize();
+			snapshot.handlerTime = handlerTime.Summarize();
+			OnCollectMetrics(snapshot);
+			return snapshot;
+		}
+
+		// Rewrites `path` with a fresh snapshot (and the rates since the previous one) every interval,
+		// from shard 0's thread. Call after construction; the dump stops with the server.
+		auto StartMetricsDump(const std::string& path, std::chrono::milliseconds interval, IRC::MetricsFormat format) -> void
+		{
+			metricsTimer = std::make_unique<boost::asio::steady_timer>(shards[0]->context);
+			ScheduleMetricsDump(path, interval, format, GetMetrics());
+		}
+
+	protected:
+		// A connection's place in its shard's heartbeat wheel: the read total and tick it was last seen
+		// making progress at.
+		struct Liveness
+		{
+			uint32_t clientID = 0;
+			uint64_t bytesRead = 0;
+			uint64_t lastActive = 0;
+		};
+
+		struct Shard
+		{
+			Shard(uint32_t index, uint32_t shardCount)
+				: index(index),
+				workGuard(boost::asio::make_work_guard(context)),
+				acceptor(context),
+				connections(shardCount, index),
+				heartbeatTimer(context)
+			{ }
+
+			uint32_t index;
+			boost::asio::io_context context;
+			boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard;
+			boost::asio::ip::tcp::acceptor acceptor;
+			std::thread thread;
+
+			// Keyed by connection ID; touched only from this shard's thread. The shards share one
+			// key space, so the owning shard can be worked out from the ID alone.
+			IRC::SlotMap<std::shared_ptr<IRC::Connection<T>>> connections;
+
+			// One entry per connection, also only touched from this shard's thread.
+			IRC::TimerWheel<Liveness> liveness;
+			boost::asio::steady_timer heartbeatTimer;
+
+			IRC::TrafficCounters traffic;
+		};
+
+		struct HandlerWorker
+		{
+			IRC::InboundQueue<T> queue;
+			std::vector<IRC::IdentifyingMessage<T>> batch;
+			std::thread thread;
+		};
+
+		// With SO_REUSEPORT every shard listens on the port itself and the kernel spreads the
+		// incoming connections. Without it, shard 0 accepts and hands sockets out round-robin.
+		auto OpenAcceptors() -> void
+		{
+			const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+
+#ifdef SO_REUSEPORT
+			const size_t listeningShards = shards.size();
+#else
+			const size_t listeningShards = 1;
+#endif
+			for (size_t index = 0; index < listeningShards; index++)
+			{
+				auto& acceptor = shards[index]->acceptor;
+				acceptor.open(endpoint.protocol());
+				acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+				if (shards.size() > 1)
+					acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+				acceptor.bind(endpoint);
+				acceptor.listen();
+			}
+		}
+
+		auto NextTargetShard(Shard& listeningShard) -> Shard&
+		{
+			if (shards.size() == 1 || listeningShard.index != 0 || shards[1]->acceptor.is_open())
+				return listeningShard;
+
+			return *shards[nextShard++ % shards.size()];
+		}
+
+		static auto PinCurrentThread(uint32_t index) -> void
+		{
+			const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+			const unsigned core = index % cores;
+#if defined(_WIN32)
+			SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+		}
+
+	public:
 		auto ProcessAcceptedConnection(std::shared_ptr<IRC::Connection<T>>& newConnection)
 		{
-			connections.push_back(std::move(newConnection));
-			connections.back()->ConnectToClient(IDCounter++);
-			printf("[%d] Connection Approved\n", connections.back()->GetID());
+			connectionsAccepted.fetch_add(1, std::memory_order_relaxed);
+			newConnection->ConnectToClient();
+			IRC::Log::Info("[{}] Connection Approved", newConnection->GetID());
 		}
 
-		void WaitForClientConnection()
+		void WaitForClientConnection(Shard& listeningShard)
 		{
-			asioAcceptor.async_accept(
-				[this](std::error_code ec, boost::asio::ip::tcp::socket socket)
+			Shard& targetShard = NextTargetShard(listeningShard);
+
+			listeningShard.acceptor.async_accept(targetShard.context,
+				[this, &listeningShard, &targetShard](std::error_code ec, boost::asio::ip::tcp::socket socket)
 				{
 					if (!ec)
 					{
-						printf("[Server] New Connection: %s\n", socket.remote_endpoint().address().to_string().c_str());
+						if (IRC::Log::IsEnabled(IRC::LogLevel::info))
+							IRC::Log::Info("[Server] New Connection: {}", socket.remote_endpoint().address().to_string());
 
 						std::shared_ptr<IRC::Connection<T>> newConnection =
 							std::make_shared<IRC::Connection<T>>(IRC::Connection<T>::Owner::server,
-																 asioContext, 
-																 std::move(socket), 
+																 targetShard.context,
+																 std::move(socket),
 																 inQueue);
+						newConnection->SetShard(targetShard.index);
+						newConnection->SetOutQueueLimits(outQueueLimits);
+						newConnection->SetMaxFrameSize(maxFrameSize);
+						newConnection->SetTrafficCounters(&targetShard.traffic);
+						if ((dispatcher && inlineDispatch) || !handlerWorkers.empty())
+							newConnection->SetOnMessage([this](IRC::IdentifyingMessage<T>& incoming) { RouteIncoming(incoming); });
 
-						if (OnClientConnect(newConnection))
+						if (&targetShard == &listeningShard)
 						{
-							ProcessAcceptedConnection(newConnection);
+							AcceptOnShard(targetShard, newConnection);
 						}
 						else
 						{
-							std::cout << "[Server] Connection Denied\n";
+							boost::asio::post(targetShard.context,
+								[this, &targetShard, newConnection]() mutable { AcceptOnShard(targetShard, newConnection); });
 						}
 					}
 					else
 					{
-						std::cout << "[Server] New Connection Error: " << ec.message() << "\n";
+						acceptErrors.fetch_add(1, std::memory_order_relaxed);
+						IRC::Log::Warning("[Server] New Connection Error: {}", ec.message());
 					}
 
-					WaitForClientConnection();
+					WaitForClientConnection(listeningShard);
 				});
 		}
 
@@ -92,80 +363,335 @@ namespace IRC
 			return client && client->IsConnected();
 		}
 
-		void ProcessDisconnection(std::shared_ptr<IRC::Connection<T>>& client)
+		auto ShardOfClient(uint32_t clientID) const -> uint32_t
 		{
-			OnClientDisconnect(client);
-			client.reset();
+			return IRC::SlotMap<std::shared_ptr<IRC::Connection<T>>>::IndexOf(clientID) % shards.size();
 		}
 
 		void MessageClient(std::shared_ptr<IRC::Connection<T>> client, const IRC::Message<T>& msg)
+		{
+			MessageClient(std::move(client), IRC::MakeSharedMessage(msg));
+		}
+
+		void MessageClient(std::shared_ptr<IRC::Connection<T>> client, const IRC::SharedMessage<T>& msg)
 		{
 			if (IsClientAlive(client))
-			{
 				client->Send(msg);
+		}
+
+		// O(1) lookup on the shard that owns the ID; silently dropped if the client is gone.
+		void MessageClient(uint32_t clientID, const IRC::SharedMessage<T>& msg)
+		{
+			PostToClient(clientID, [msg](std::shared_ptr<IRC::Connection<T>>& client) { client->Send(msg); });
+		}
+
+		// Opens a connection out to another server, on shard 0. Its messages are handled like an
+		// accepted client's, but it has no ID, is not in any shard's registry (so it gets no broadcasts
+		// and no heartbeat checks) and is forgotten once closed: onClose runs then, on shard 0's thread,
+		// and also if the host cannot be resolved or reached.
+		auto ConnectToPeer(const std::string& host, uint16_t peerPort, std::function<void(std::shared_ptr<IRC::Connection<T>>)> onClose) -> std::shared_ptr<IRC::Connection<T>>
+		{
+			Shard& shard = *shards[0];
+			auto peer = std::make_shared<IRC::Connection<T>>(IRC::Connection<T>::Owner::client,
+															 shard.context,
+															 boost::asio::ip::tcp::socket(shard.context),
+															 inQueue);
+			peer->SetShard(shard.index);
+			peer->SetOutQueueLimits(outQueueLimits);
+			peer->SetMaxFrameSize(maxFrameSize);
+			peer->SetTrafficCounters(&shard.traffic);
+			peer->SetOnClose(std::move(onClose));
+			if ((dispatcher && inlineDispatch) || !handlerWorkers.empty())
+				peer->SetOnMessage([this](IRC::IdentifyingMessage<T>& incoming) { RouteIncoming(incoming); });
+
+			// No endpoints make the connect fail, which closes the connection like any other failure.
+			auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(shard.context);
+			resolver->async_resolve(host, std::to_string(peerPort),
+				[resolver, peer, host](std::error_code ec, boost::asio::ip::tcp::resolver::results_type endpoints)
+				{
+					if (ec)
+						IRC::Log::Warning("[Server] Cannot resolve {}: {}", host, ec.message());
+					peer->ConnectToServer(endpoints);
+				});
+			return peer;
+		}
+
+		// Runs `handler` with the connection on the I/O thread of the shard that owns it, for work a
+		// handler worker wants done there. Skipped if the client is gone by then.
+		template<typename Handler>
+		void PostToClient(uint32_t clientID, Handler handler)
+		{
+			Shard* pShard = shards[ShardOfClient(clientID)].get();
+			boost::asio::post(pShard->context,
+				[pShard, clientID, handler = std::move(handler)]() mutable
+				{
+					if (auto client = pShard->connections.Find(clientID))
+						handler(*client);
+				});
+		}
+
+		void MessageAllClients(const IRC::Message<T>& msg, std::shared_ptr<IRC::Connection<T>> pIgnoreClient = nullptr)
+		{
+			MessageAllClients(IRC::MakeSharedMessage(msg), std::move(pIgnoreClient));
+		}
+
+		// The message is encoded once; every shard and every connection only takes a reference to it.
+		// The broadcast is handed to every shard as a posted message, and each shard then walks only
+		// the connections it owns, on its own thread. `producer` is the connection it is sent on behalf
+		// of; see Connection::Send.
+		void MessageAllClients(const IRC::SharedMessage<T>& msg, std::shared_ptr<IRC::Connection<T>> pIgnoreClient = nullptr,
+							   std::shared_ptr<IRC::Connection<T>> producer = nullptr)
+		{
+			for (auto& shard : shards)
+			{
+				Shard* pShard = shard.get();
+				boost::asio::post(pShard->context,
+					[this, pShard, msg, pIgnoreClient, producer]() { MessageShardClients(*pShard, msg, pIgnoreClient, producer); });
+			}
+		}
+
+		void Update(size_t nMaxMessages = -1, bool bWait = false)
+		{
+			if (bWait) inQueue.wait();
+
+			size_t nMessageCount = 0;
+			while (nMessageCount < nMaxMessages)
+			{
+				if (inQueue.drain(updateBatch, std::min(nMaxMessages - nMessageCount, maxUpdateBatch)) == 0)
+					break;
+
+				HandleBatch(updateBatch);
+				nMessageCount += updateBatch.size();
+				updateBatch.clear();
+			}
+		}
+
+	private:
+		// The connection is registered (and so has its ID) before OnClientConnect sees it.
+		auto AcceptOnShard(Shard& shard, std::shared_ptr<IRC::Connection<T>>& newConnection) -> void
+		{
+			auto id = shard.connections.Insert(newConnection);
+			if (!id)
+			{
+				connectionsDenied.fetch_add(1, std::memory_order_relaxed);
+				IRC::Log::Warning("[Server] Connection Denied: registry full");
+				return;
+			}
+
+			newConnection->SetID(*id);
+			newConnection->SetOnClose([this, &shard](std::shared_ptr<IRC::Connection<T>> client) { ReapConnection(shard, client); });
+
+			if (OnClientConnect(newConnection))
+			{
+				ProcessAcceptedConnection(newConnection);
+				if (heartbeatIntervalTicks > 0)
+					shard.liveness.Schedule(shard.liveness.Now() + heartbeatIntervalTicks, { *id, 0, shard.liveness.Now() });
 			}
 			else
 			{
-				ProcessDisconnection(client);
-				connections.erase(
-					std::remove(connections.begin(), connections.end(), client), connections.end());
+				newConnection->SetOnClose(nullptr);
+				shard.connections.Erase(*id);
+				connectionsDenied.fetch_add(1, std::memory_order_relaxed);
+				IRC::Log::Info("[Server] Connection Denied");
 			}
 		}
 
-		void MessageAllClients(const IRC::Message<T>& msg, std::shared_ptr<IRC::Connection<T>> pIgnoreClient = nullptr)
+		// One clock read per message: the end of one handler is the start of the next.
+		auto HandleBatch(std::vector<IRC::IdentifyingMessage<T>>& batch) -> void
 		{
-			bool isThereADeadClient = false;
+			auto handlerStart = std::chrono::steady_clock::now();
+			for (auto& msg : batch)
+			{
+				inboundWait.Record(Nanoseconds(handlerStart - msg.queuedAt));
+				if (!dispatcher || !dispatcher(*this, msg, IRC::Dispatch::queued))
+					OnMessage(msg.remote, msg.msg);
 
-			for (auto itr = connections.rbegin(); itr != connections.rend(); itr++)
+				const auto handlerEnd = std::chrono::steady_clock::now();
+				handlerTime.Record(Nanoseconds(handlerEnd - handlerStart));
+				handlerStart = handlerEnd;
+			}
+
+			messagesHandled.fetch_add(batch.size(), std::memory_order_relaxed);
+		}
+
+		// Runs on the shard thread as each message is framed: inline routes are handled on the spot
+		// (the message was framed at queuedAt, so the handler time is the only clock read added),
+		// everything else goes to the connection's handler worker or, without workers, to Update.
+		auto RouteIncoming(IRC::IdentifyingMessage<T>& incoming) -> void
+		{
+			if (inlineDispatch && dispatcher && dispatcher(*this, incoming, IRC::Dispatch::onShard))
 			{
-				if (IsClientAlive(*itr))
-				{
-					if ((*itr) != pIgnoreClient)
-						(*itr)->Send(msg);
-				}
-				else
-				{
-					ProcessDisconnection(*itr);
-					isThereADeadClient = true;
-				}
+				handlerTime.Record(Nanoseconds(std::chrono::steady_clock::now() - incoming.queuedAt));
+				messagesHandled.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			if (handlerWorkers.empty())
+			{
+				inQueue.push_back(std::move(incoming));
+				return;
 			}
 
-			if (isThereADeadClient)
-				connections.erase(
-					std::remove(connections.begin(), connections.end(), nullptr), connections.end());
+			// IDs are dense slot indices, so the index alone spreads connections evenly.
+			const size_t index = IRC::SlotMap<std::shared_ptr<IRC::Connection<T>>>::IndexOf(incoming.remote->GetID());
+			handlerWorkers[index % handlerWorkers.size()]->queue.push_back(std::move(incoming));
 		}
 
-		void Update(size_t nMaxMessages = -1, bool bWait = false)
+		auto RunHandlerWorker(HandlerWorker& worker) -> void
 		{
-			if (bWait) inQueue.wait();
+			while (true)
+			{
+				worker.queue.wait();
+				worker.queue.drain(worker.batch, maxUpdateBatch);
+				if (!handlerWorkersRunning.load(std::memory_order_relaxed))
+					break;
 
-			size_t nMessageCount = 0;
-			while (nMessageCount < nMaxMessages && !inQueue.empty())
+				std::erase_if(worker.batch, [](const IRC::IdentifyingMessage<T>& msg) { return msg.remote == nullptr; });
+				HandleBatch(worker.batch);
+				worker.batch.clear();
+			}
+		}
+
+		// Runs on the shard's thread as soon as the connection closes.
+		auto ReapConnection(Shard& shard, std::shared_ptr<IRC::Connection<T>> client) -> void
+		{
+			if (shard.connections.Erase(client->GetID()))
+			{
+				connectionsReaped.fetch_add(1, std::memory_order_relaxed);
+				OnClientDisconnect(client);
+			}
+		}
+
+		// Ticks are counted from Start() rather than from the last wakeup, so a late timer catches up
+		// instead of drifting.
+		auto ScheduleHeartbeatTick(Shard& shard) -> void
+		{
+			shard.heartbeatTimer.expires_at(heartbeatStart + heartbeatTick * (shard.liveness.Now() + 1));
+			shard.heartbeatTimer.async_wait([this, &shard](std::error_code ec)
+				{
+					if (ec)
+						return;
+
+					const uint64_t tick = static_cast<uint64_t>((std::chrono::steady_clock::now() - heartbeatStart) / heartbeatTick);
+					shard.liveness.Advance(tick, [this, &shard](Liveness entry) { CheckLiveness(shard, entry); });
+					ScheduleHeartbeatTick(shard);
+				});
+		}
+
+		// Any byte read since the last check counts as activity, so the check reads one counter and
+		// nothing is done per message. Entries of connections already reaped are simply let go.
+		auto CheckLiveness(Shard& shard, Liveness entry) -> void
+		{
+			auto* found = shard.connections.Find(entry.clientID);
+			if (!found)
+				return;
+
+			std::shared_ptr<IRC::Connection<T>> client = *found;
+			const uint64_t now = shard.liveness.Now();
+			const uint64_t bytesRead = client->GetReadStats().bytesRead;
+			if (bytesRead != entry.bytesRead || client->IsReadPaused())
+			{
+				entry.bytesRead = bytesRead;
+				entry.lastActive = now;
+				shard.liveness.Schedule(now + heartbeatIntervalTicks, entry);
+				return;
+			}
+
+			if (now - entry.lastActive >= idleTimeoutTicks)
 			{
-				auto msg = inQueue.pop_front();
+				IRC::Log::Info("[{}] Idle timeout", entry.clientID);
+				shard.traffic.idleDisconnects.fetch_add(1, std::memory_order_relaxed);
+				client->Disconnect();
+				return;
+			}
+
+			client->SendHeartbeat();
+			shard.traffic.heartbeatsSent.fetch_add(1, std::memory_order_relaxed);
+			shard.liveness.Schedule(std::min(now + heartbeatIntervalTicks, entry.lastActive + idleTimeoutTicks), entry);
+		}
+
+		auto ScheduleMetricsDump(std::string path, std::chrono::milliseconds interval, IRC::MetricsFormat format, IRC::MetricsSnapshot previous) -> void
+		{
+			metricsTimer->expires_after(interval);
+			metricsTimer->async_wait(
+				[this, path = std::move(path), interval, format, previous = std::move(previous)](std::error_code ec) mutable
+				{
+					if (ec)
+						return;
 
-				OnMessage(msg.remote, msg.msg);
+					IRC::MetricsSnapshot snapshot = GetMetrics();
+					const std::string report = IRC::FormatMetrics(snapshot, &previous, format);
 
-				nMessageCount++;
+					if (FILE* file = std::fopen(path.c_str(), "w"))
+					{
+						std::fwrite(report.data(), 1, report.size(), file);
+						std::fclose(file);
+					}
+					else
+					{
+						IRC::Log::Warning("[Server] Cannot write metrics to {}", path);
+					}
+
+					ScheduleMetricsDump(std::move(path), interval, format, std::move(snapshot));
+				});
+		}
+
+		static auto Nanoseconds(std::chrono::steady_clock::duration duration) -> uint64_t
+		{
+			return static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+		}
+
+		void MessageShardClients(Shard& shard, const IRC::SharedMessage<T>& msg, const std::shared_ptr<IRC::Connection<T>>& pIgnoreClient,
+								 const std::shared_ptr<IRC::Connection<T>>& producer)
+		{
+			for (auto& client : shard.connections)
+			{
+				if (client != pIgnoreClient && client->ReceivesBroadcasts())
+					client->Send(msg, producer);
 			}
 		}
 
 	protected:
-		virtual bool OnClientConnect(std::shared_ptr<IRC::Connection<T>> client) { return false; }
-		virtual void OnClientDisconnect(std::shared_ptr<IRC::Connection<T>> client) { }
-		virtual void OnMessage(std::shared_ptr<IRC::Connection<T>> client, IRC::Message<T>& msg) { }
+		virtual bool OnClientConnect(std::shared_ptr<IRC::Connection<T>> /*client*/) { return false; }
+		virtual void OnClientDisconnect(std::shared_ptr<IRC::Connection<T>> /*client*/) { }
+		virtual void OnMessage(std::shared_ptr<IRC::Connection<T>> /*client*/, IRC::Message<T>& /*msg*/) { }
+		// Adds the derived server's own figures to a snapshot; called from whichever thread asked for it.
+		virtual void OnCollectMetrics(IRC::MetricsSnapshot& /*snapshot*/) { }
 
 
 	protected:
-		IRC::ThreadSafeQueue<IRC::IdentifyingMessage<T>> inQueue;
+		IRC::InboundQueue<T> inQueue;
+		std::vector<IRC::IdentifyingMessage<T>> updateBatch;
+		static constexpr size_t maxUpdateBatch = 256;
+
+		uint16_t port;
+		std::vector<std::unique_ptr<Shard>> shards;
+		std::atomic<size_t> nextShard = 1;
+
+		IRC::OutQueueLimits<T> outQueueLimits;
+		size_t maxFrameSize = IRC::defaultMaxFrameSize;
 
-		std::deque<std::shared_ptr<IRC::Connection<T>>> connections;
+		bool (*dispatcher)(IServer&, IRC::IdentifyingMessage<T>&, IRC::Dispatch) = nullptr;
+		bool inlineDispatch = false;
 
-		boost::asio::io_context asioContext;
-		std::thread contextThread;
+		std::vector<std::unique_ptr<HandlerWorker>> handlerWorkers;
+		std::atomic<bool> handlerWorkersRunning = true;
+		std::atomic<bool> stopped = false;
 
-		boost::asio::ip::tcp::acceptor asioAcceptor;
+		// In ticks of heartbeatTick; no heartbeats while heartbeatIntervalTicks is 0.
+		std::chrono::milliseconds heartbeatTick{ 1 };
+		uint64_t heartbeatIntervalTicks = 0;
+		uint64_t idleTimeoutTicks = 0;
+		std::chrono::steady_clock::time_point heartbeatStart;
 
-		uint32_t IDCounter = 10000;
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::atomic<uint64_t> connectionsAccepted = 0;
+		std::atomic<uint64_t> connectionsDenied = 0;
+		std::atomic<uint64_t> acceptErrors = 0;
+		std::atomic<uint64_t> connectionsReaped = 0;
+		std::atomic<uint64_t> messagesHandled = 0;
+		IRC::Histogram inboundWait;
+		IRC::Histogram handlerTime;
+		std::unique_ptr<boost::asio::steady_timer> metricsTimer;
 	};
-}
\ No newline at end of file
+}
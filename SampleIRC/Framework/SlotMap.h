@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Common.h"
+
+namespace IRC
+{
+	// Generational slot map. Keys are 32 bits: the upper bits hold the slot's generation, the lower
+	// indexBits hold its global index. Insert, Find and Erase are O(1); the values are kept densely
+	// packed for iteration, so erasing moves the last value into the hole.
+	//
+	// Several maps can share one key space: map `offset` of `stride` only hands out global indices
+	// with index % stride == offset, which lets a key be routed back to the map that issued it.
+	// Freed slots are reused in FIFO order so a stale key takes as long as possible to alias.
+	template<typename Value>
+	class SlotMap
+	{
+	public:
+		using Key = uint32_t;
+
+		static constexpr uint32_t indexBits = 20;
+		static constexpr uint32_t indexMask = (1u << indexBits) - 1;
+		static constexpr uint32_t maxGeneration = (1u << (32 - indexBits)) - 1;
+
+		SlotMap(uint32_t stride = 1, uint32_t offset = 0)
+			: stride(std::max<uint32_t>(stride, 1)), offset(offset)
+		{ }
+
+		static auto IndexOf(Key key) -> uint32_t
+		{
+			return key & indexMask;
+		}
+
+		auto Insert(Value value) -> std::optional<Key>
+		{
+			uint32_t local;
+			if (!freeSlots.empty())
+			{
+				local = freeSlots.front();
+				freeSlots.pop_front();
+			}
+			else
+			{
+				local = static_cast<uint32_t>(slots.size());
+				if (GlobalIndex(local) > indexMask)
+					return std::nullopt;
+				slots.push_back({});
+			}
+
+			Slot& slot = slots[local];
+			slot.denseIndex = static_cast<uint32_t>(values.size());
+			values.push_back(std::move(value));
+			owners.push_back(local);
+
+			return static_cast<Key>((slot.generation << indexBits) | GlobalIndex(local));
+		}
+
+		auto Find(Key key) -> Value*
+		{
+			const uint32_t local = LocalSlot(key);
+			return local != vacant ? &values[slots[local].denseIndex] : nullptr;
+		}
+
+		auto Contains(Key key) const -> bool
+		{
+			return LocalSlot(key) != vacant;
+		}
+
+		auto Erase(Key key) -> bool
+		{
+			const uint32_t local = LocalSlot(key);
+			if (local == vacant)
+				return false;
+
+			Slot* slot = &slots[local];
+			const uint32_t hole = slot->denseIndex;
+			if (hole != values.size() - 1)
+			{
+				values[hole] = std::move(values.back());
+				owners[hole] = owners.back();
+				slots[owners[hole]].denseIndex = hole;
+			}
+			values.pop_back();
+			owners.pop_back();
+
+			slot->denseIndex = vacant;
+			slot->generation = slot->generation == maxGeneration ? 1 : slot->generation + 1;
+			freeSlots.push_back(local);
+			return true;
+		}
+
+		auto size() const -> size_t { return values.size(); }
+		auto empty() const -> bool { return values.empty(); }
+
+		auto begin() { return values.begin(); }
+		auto end() { return values.end(); }
+		auto begin() const { return values.begin(); }
+		auto end() const { return values.end(); }
+
+	private:
+		static constexpr uint32_t vacant = UINT32_MAX;
+
+		struct Slot
+		{
+			uint32_t generation = 1;
+			uint32_t denseIndex = vacant;
+		};
+
+		auto GlobalIndex(uint32_t local) const -> uint64_t
+		{
+			return static_cast<uint64_t>(local) * stride + offset;
+		}
+
+		auto LocalSlot(Key key) const -> uint32_t
+		{
+			const uint32_t index = IndexOf(key);
+			if (index % stride != offset)
+				return vacant;
+
+			const uint32_t local = (index - offset) / stride;
+			if (local >= slots.size())
+				return vacant;
+
+			const Slot& slot = slots[local];
+			if (slot.denseIndex == vacant || slot.generation != (key >> indexBits))
+				return vacant;
+			return local;
+		}
+
+		uint32_t stride;
+		uint32_t offset;
+
+		std::vector<Slot> slots;
+		std::vector<Value> values;
+		std::vector<uint32_t> owners;
+		std::deque<uint32_t> freeSlots;
+	};
+}
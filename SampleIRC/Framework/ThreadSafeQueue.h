@@ -50,6 +50,15 @@ namespace IRC
 			cvBlocking.notify_one();
 		}
 
+		auto push_back(T&& item) -> void
+		{
+			std::scoped_lock lock(queueMutex);
+			queue.emplace_back(std::move(item));
+
+			std::unique_lock<std::mutex> ul(blockingMutex);
+			cvBlocking.notify_one();
+		}
+
 		auto push_front(const T& item) -> void
 		{
 			std::scoped_lock lock(queueMutex);
@@ -59,6 +68,15 @@ namespace IRC
 			cvBlocking.notify_one();
 		}
 
+		auto drain(std::vector<T>& batch, size_t maxItems = SIZE_MAX) -> size_t
+		{
+			std::scoped_lock lock(queueMutex);
+			size_t drained = std::min(maxItems, queue.size());
+			std::move(queue.begin(), queue.begin() + drained, std::back_inserter(batch));
+			queue.erase(queue.begin(), queue.begin() + drained);
+			return drained;
+		}
+
 		auto empty() -> bool
 		{
 			std::scoped_lock lock(queueMutex);
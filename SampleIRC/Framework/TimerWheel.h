@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Common.h"
+
+namespace IRC
+{
+	// Hierarchical timer wheel over integer ticks: levelCount levels of 64 slots, each slot of a level
+	// spanning a whole turn of the level below. Scheduling is O(1). Advancing by a tick is O(1) plus the
+	// entries that come due, and an entry moves down at most once per level on its way there, so the
+	// cost per tick does not depend on how many entries are waiting. Entries cannot be cancelled; the
+	// owner checks whether a fired entry is still wanted, which is cheaper than tracking it to remove.
+	template<typename Payload>
+	class TimerWheel
+	{
+	public:
+		static constexpr size_t slotBits = 6;
+		static constexpr size_t slotCount = size_t(1) << slotBits;
+		static constexpr size_t levelCount = 4;
+		static constexpr uint64_t maxDelay = (uint64_t(1) << (slotBits * levelCount)) - 1;
+
+		auto Now() const -> uint64_t
+		{
+			return current;
+		}
+
+		auto Size() const -> size_t
+		{
+			return size;
+		}
+
+		// Due at `deadline`, or on the next tick if that has already passed. Deadlines more than
+		// maxDelay ticks away are brought in to maxDelay.
+		auto Schedule(uint64_t deadline, Payload payload) -> void
+		{
+			deadline = std::clamp(deadline, current + 1, current + maxDelay);
+			Place({ deadline, std::move(payload) });
+			size++;
+		}
+
+		// Moves time forward to `tick`, calling expired(payload) for each entry as it comes due, in
+		// deadline order across ticks. expired may schedule new entries.
+		template<typename Handler>
+		auto Advance(uint64_t tick, Handler&& expired) -> void
+		{
+			while (current < tick)
+			{
+				current++;
+
+				// Where a level turns over, the next level's slot for the new position moves down into
+				// it; higher levels first, since what they shed may land in a slot cascading this tick.
+				size_t wrapped = 0;
+				while (wrapped + 1 < levelCount && (current & ((uint64_t(1) << (slotBits * (wrapped + 1))) - 1)) == 0)
+					wrapped++;
+				for (size_t level = wrapped; level > 0; level--)
+					Cascade(level);
+
+				auto& slot = slots[0][current & (slotCount - 1)];
+				if (slot.empty())
+					continue;
+
+				firing.swap(slot);
+				size -= firing.size();
+				for (auto& entry : firing)
+					expired(std::move(entry.payload));
+				firing.clear();
+			}
+		}
+
+	private:
+		struct Entry
+		{
+			uint64_t deadline;
+			Payload payload;
+		};
+
+		// The level is the highest digit (of slotBits bits) where the deadline and now differ, so the
+		// entry is met by that level's cascade before any lower digit matters.
+		auto Place(Entry&& entry) -> void
+		{
+			const uint64_t differing = entry.deadline ^ current;
+			size_t level = 0;
+			while (level + 1 < levelCount && (differing >> (slotBits * (level + 1))) != 0)
+				level++;
+
+			slots[level][(entry.deadline >> (slotBits * level)) & (slotCount - 1)].push_back(std::move(entry));
+		}
+
+		auto Cascade(size_t level) -> void
+		{
+			auto& slot = slots[level][(current >> (slotBits * level)) & (slotCount - 1)];
+			if (slot.empty())
+				return;
+
+			cascading.swap(slot);
+			for (auto& entry : cascading)
+				Place(std::move(entry));
+			cascading.clear();
+		}
+
+		std::array<std::array<std::vector<Entry>, slotCount>, levelCount> slots;
+		std::vector<Entry> firing;
+		std::vector<Entry> cascading;
+		uint64_t current = 0;
+		size_t size = 0;
+	};
+}
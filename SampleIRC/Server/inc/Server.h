@@ -1,18 +1,160 @@
 #include <iostream>
 #include <Framework/Server.h>
 #include <Framework/MessageTypes.h>
+#include <Framework/ChannelIndex.h>
+#include <Framework/ReplayHistory.h>
+#include <Framework/Journal.h>
+#include <Framework/DuplicateFilter.h>
 
 class IRCServer : public IRC::IServer<IRCMessageType>
 {
 public:
-	IRCServer(uint16_t nPort) : IRC::IServer<IRCMessageType>(nPort) { }
+	IRCServer(uint16_t nPort, uint32_t nShards = 1, bool inlineDispatch = false) : IRC::IServer<IRCMessageType>(nPort, nShards)
+	{
+		SetOutQueueLimits({ .policy = IRC::SlowConsumerPolicy::dropOldest, .isControl = IsControlMessage });
+		UseHandlerTable<IRCServer, handlers>();
+		SetInlineDispatch(inlineDispatch);
+		SetHeartbeat(std::chrono::seconds(15), std::chrono::seconds(45));
+		channels.SetOnChannelClosed([this](IRC::ChannelIndex<std::shared_ptr<IRC::Connection<IRCMessageType>>>::ChannelID channel)
+			{
+				std::scoped_lock lock(historyMutex);
+				history.Clear(static_cast<IRC::ReplayHistory<IRCMessageType>::RoomID>(channel + 1));
+			});
+	}
+
+	// Stops the server's threads while the channels, history, journal and links they use still exist.
+	~IRCServer() override
+	{
+		Stop();
+	}
+
 	auto Run() -> void;
 
+	// Appends every server-wide relay to a journal in options.directory, and numbers them on from the
+	// journal's last record. Call before Start().
+	auto EnableJournal(IRC::JournalOptions options) -> void;
+
+	// Joins a network of linked servers as `node`, which no other server in it may share. Server-wide
+	// messages then reach every client in the network: each goes to this server's links in batches,
+	// and every server relays it once to its own clients, numbered there, and passes it on to its other
+	// links. Servers only link with one that sends the same `secret`, and an empty one links with
+	// none. Call before Start(), then AddPeer for the servers this one links to.
+	auto EnableFederation(uint32_t node, std::string secret) -> void;
+
+	// Keeps a link open to the server at host:port, trying again every peerRetry while it is down. Of
+	// two servers, one adding the other is enough; a link carries traffic both ways.
+	auto AddPeer(const std::string& host, uint16_t peerPort) -> void;
+
 protected:
+	static bool IsControlMessage(IRCMessageType id);
+
 	virtual bool OnClientConnect(std::shared_ptr<IRC::Connection<IRCMessageType>> client) override;
 	virtual void OnClientDisconnect(std::shared_ptr<IRC::Connection<IRCMessageType>> client) override;
-	virtual void OnMessage(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) override;
-	
+	virtual void OnCollectMetrics(IRC::MetricsSnapshot& snapshot) override;
+
+	auto ProcessPing(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
 	auto ProcessMessageAll(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
-	
+	auto ProcessJoinChannel(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessPartChannel(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessChannelMessage(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessChannelData(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessReplay(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessAdminMetrics(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessClientHello(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessServerAccept(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessLinkHello(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+	auto ProcessLinkBatch(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void;
+
+	// Numbers, keeps, journals and broadcasts a server-wide message, on behalf of the connection it
+	// came in on; returns its number. Caller holds historyMutex.
+	auto RelayServerMessage(uint32_t senderID, std::string_view text, const std::shared_ptr<IRC::Connection<IRCMessageType>>& producer) -> uint64_t;
+
+	static constexpr uint32_t capabilities = IRC::Capability::compression | IRC::Capability::compactFraming;
+	// Shorter bodies gain too little to be worth a compression pass.
+	static constexpr size_t compressionThreshold = 256;
+
+	// Pings and metrics only touch the sender, so they can answer straight from the shard thread.
+	// Broadcasts and channel traffic stay queued to keep one order across all clients.
+	static constexpr auto handlers = IRC::MakeHandlerTable<IRCMessageType, IRCServer, IRCMessageTypeCount>({
+		{ IRCMessageType::ServerPing,		&IRCServer::ProcessPing,			IRC::Dispatch::onShard },
+		{ IRCMessageType::AdminMetrics,		&IRCServer::ProcessAdminMetrics,	IRC::Dispatch::onShard },
+		{ IRCMessageType::ClientHello,		&IRCServer::ProcessClientHello,		IRC::Dispatch::onShard },
+		{ IRCMessageType::MessageAll,		&IRCServer::ProcessMessageAll,		IRC::Dispatch::queued },
+		{ IRCMessageType::ServerMessage,	&IRCServer::ProcessMessageAll,		IRC::Dispatch::queued },
+		{ IRCMessageType::JoinChannel,		&IRCServer::ProcessJoinChannel,		IRC::Dispatch::queued },
+		{ IRCMessageType::PartChannel,		&IRCServer::ProcessPartChannel,		IRC::Dispatch::queued },
+		{ IRCMessageType::ChannelMessage,	&IRCServer::ProcessChannelMessage,	IRC::Dispatch::queued },
+		{ IRCMessageType::ChannelData,		&IRCServer::ProcessChannelData,		IRC::Dispatch::queued },
+		{ IRCMessageType::Replay,			&IRCServer::ProcessReplay,			IRC::Dispatch::queued },
+		{ IRCMessageType::ServerAccept,		&IRCServer::ProcessServerAccept,	IRC::Dispatch::queued },
+		{ IRCMessageType::LinkHello,		&IRCServer::ProcessLinkHello,		IRC::Dispatch::queued },
+		{ IRCMessageType::LinkBatch,		&IRCServer::ProcessLinkBatch,		IRC::Dispatch::queued },
+	});
+
+	// Joins/parts/relays come from the Update thread, disconnects from the shard threads. A channel
+	// lasts while it has members, so a client can keep at most maxChannelsPerClient of them open.
+	std::mutex channelMutex;
+	IRC::ChannelIndex<std::shared_ptr<IRC::Connection<IRCMessageType>>> channels;
+	static constexpr size_t maxChannelsPerClient = 64;
+
+	// Room 0 holds the server-wide ServerMessages, room c + 1 channel c's messages; a channel's room
+	// is cleared when it closes, before its ID can go to another channel. Numbering and
+	// relaying happen under the same lock, so every client sees a room's messages in sequence order.
+	// Taken after channelMutex when both are needed.
+	static constexpr IRC::ReplayHistory<IRCMessageType>::RoomID serverRoom = 0;
+	std::mutex historyMutex;
+	IRC::ReplayHistory<IRCMessageType> history{ { .messagesPerRoom = 256, .maxBytes = 16 * 1024 * 1024 } };
+
+	// Optional; written under historyMutex, in sequence order. A replay from it sends at most
+	// maxJournalReplay messages, and the client asks again from the last one it got.
+	std::unique_ptr<IRC::Journal> journal;
+	static constexpr size_t maxJournalReplay = 1024;
+
+	// A connection to another server, either way round, once both sides have sent LinkHello. Relays
+	// for it gather in `pending` until the flush posted to its shard runs, so however many arrive in
+	// the meantime go out as one LinkBatch; a batch reaching maxLinkBatchBytes goes at once.
+	struct Link
+	{
+		std::shared_ptr<IRC::Connection<IRCMessageType>> connection;
+		uint32_t node = 0;
+		std::vector<uint8_t> pending;
+		uint32_t pendingCount = 0;
+		bool flushPosted = false;
+	};
+
+	struct Peer
+	{
+		std::string host;
+		uint16_t port = 0;
+		std::shared_ptr<IRC::Connection<IRCMessageType>> connection;
+	};
+
+	auto ConnectPeer(size_t index) -> void;
+	auto RemoveLink(const std::shared_ptr<IRC::Connection<IRCMessageType>>& connection) -> bool;
+	auto IsLink(const std::shared_ptr<IRC::Connection<IRCMessageType>>& connection) const -> bool;
+	// Caller holds linkMutex for both.
+	auto ForwardToLinks(std::span<const uint8_t> record, uint32_t origin, const IRC::Connection<IRCMessageType>* from) -> void;
+	auto FlushLink(Link& link) -> void;
+
+	static constexpr size_t maxLinkBatchBytes = 64 * 1024;
+	static constexpr std::chrono::seconds peerRetry{ 1 };
+
+	// Set before Start(). The epoch is the start time, so a restarted server numbers from 1 again
+	// without its messages being taken for ones already seen.
+	std::optional<uint32_t> node;
+	uint64_t epoch = 0;
+	std::string linkSecret;
+
+	// Taken after historyMutex, which relaying from a link needs first so that every server passes
+	// messages on in the order it numbered them.
+	mutable std::mutex linkMutex;
+	std::vector<Peer> peers;
+	std::vector<std::shared_ptr<Link>> links;
+	IRC::DuplicateFilter duplicates;
+	std::vector<uint8_t> relayRecord;
+
+	std::atomic<uint64_t> linkBatchesSent = 0;
+	std::atomic<uint64_t> linkRelaysSent = 0;
+	std::atomic<uint64_t> linkRelaysReceived = 0;
+	std::atomic<uint64_t> linkDuplicates = 0;
 };
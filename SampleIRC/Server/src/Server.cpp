@@ -1,75 +1,444 @@
 #include "Server.h"
 
-#include <ctime>
-#include <format>
+#include <Framework/MessageSchemas.h>
+#include <Framework/Log.h>
+
+// Takes as long whichever byte differs, so a client probing for the link secret learns nothing from
+// how soon it is refused.
+static auto SecretsMatch(std::string_view expected, std::string_view given) -> bool
+{
+	if (expected.empty() || expected.size() != given.size())
+		return false;
+
+	uint8_t difference = 0;
+	for (size_t index = 0; index < expected.size(); index++)
+		difference |= static_cast<uint8_t>(expected[index] ^ given[index]);
+	return difference == 0;
+}
 
 bool IRCServer::OnClientConnect(std::shared_ptr<IRC::Connection<IRCMessageType>> client)
 {
-	IRC::Message<IRCMessageType> msg;
-	msg.header.id = IRCMessageType::ServerAccept;
-	client->SetID(IDCounter++);
-	msg << client->GetID();
-	client->Send(msg);
+	client->Send(IRC::Encode(Schema::ServerAccept{ .clientID = client->GetID(), .capabilities = capabilities }));
 	return true;
 }
 
-struct Timestamp
+// Handshake and keep-alive traffic is never dropped from a slow client's out-queue.
+bool IRCServer::IsControlMessage(IRCMessageType id)
+{
+	return id == IRCMessageType::ServerAccept || id == IRCMessageType::ServerDeny || id == IRCMessageType::ServerPing
+		|| id == IRCMessageType::LinkHello;
+}
+
+void IRCServer::OnClientDisconnect(std::shared_ptr<IRC::Connection<IRCMessageType>> client)
+{
+	{
+		std::scoped_lock lock(channelMutex);
+		channels.PartAll(client->GetID());
+	}
+
+	if (RemoveLink(client))
+		IRC::Log::Info("[Federation] <{}> link closed", client->GetID());
+
+	IRC::Log::Info("[Server] <{}> disconnected", client->GetID());
+}
+
+void IRCServer::OnCollectMetrics(IRC::MetricsSnapshot& snapshot)
 {
-	int hour;
-	int minutes;
-};
+	const auto stats = history.GetStats();
+	snapshot.replayMessages = stats.messages;
+	snapshot.replayBytes = stats.bytes;
+	snapshot.replayEvicted = stats.evicted;
+
+	if (journal)
+	{
+		const auto journalStats = journal->GetStats();
+		snapshot.journalRecords = journalStats.records;
+		snapshot.journalBytes = journalStats.bytes;
+		snapshot.journalSyncs = journalStats.syncs;
+		snapshot.journalSyncFailures = journalStats.syncFailures;
+		snapshot.journalUnsynced = journalStats.lastSequence - journalStats.syncedSequence;
+	}
+
+	if (node)
+	{
+		std::scoped_lock lock(linkMutex);
+		snapshot.federationLinks = links.size();
+	}
+	snapshot.linkBatchesSent = linkBatchesSent.load(std::memory_order_relaxed);
+	snapshot.linkRelaysSent = linkRelaysSent.load(std::memory_order_relaxed);
+	snapshot.linkRelaysReceived = linkRelaysReceived.load(std::memory_order_relaxed);
+	snapshot.linkDuplicates = linkDuplicates.load(std::memory_order_relaxed);
+}
 
-auto GetTimestamp() -> Timestamp
+auto IRCServer::EnableJournal(IRC::JournalOptions options) -> void
 {
-	auto timer = std::time(nullptr);
-	auto currTime = *localtime(&timer);
+	journal = std::make_unique<IRC::Journal>(std::move(options));
 
-	return { .hour = currTime.tm_hour, .minutes = currTime.tm_min };
+	std::scoped_lock lock(historyMutex);
+	history.ResumeAt(serverRoom, journal->LastSequence() + 1);
 }
 
-auto FormatTimestamp() -> std::string
+auto IRCServer::EnableFederation(uint32_t nodeID, std::string secret) -> void
 {
-	auto timestamp = GetTimestamp();
-	return std::format("[{}:{}] ", timestamp.hour, timestamp.minutes);
+	node = nodeID;
+	linkSecret = std::move(secret);
+	epoch = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
 }
 
-void IRCServer::OnClientDisconnect(std::shared_ptr<IRC::Connection<IRCMessageType>> client)
+auto IRCServer::AddPeer(const std::string& host, uint16_t peerPort) -> void
 {
-	std::cout << FormatTimestamp() << "[Server] <" << client->GetID() << "> disconnected\n";
+	{
+		std::scoped_lock lock(linkMutex);
+		peers.push_back({ host, peerPort, nullptr });
+	}
+	ConnectPeer(peers.size() - 1);
+}
+
+// Until the link is up, the peer may still broadcast to this connection as to any client; shutting
+// broadcasts off here marks it, so those get ignored.
+auto IRCServer::ConnectPeer(size_t index) -> void
+{
+	std::scoped_lock lock(linkMutex);
+	Peer& peer = peers[index];
+	// The callback runs on a shard thread, which must not read `peers` without the lock.
+	peer.connection = ConnectToPeer(peer.host, peer.port, [this, index, host = peer.host, port = peer.port](std::shared_ptr<IRC::Connection<IRCMessageType>> closed)
+		{
+			if (RemoveLink(closed))
+				IRC::Log::Info("[Federation] Link to {}:{} closed", host, port);
+			else
+				IRC::Log::Debug("[Federation] Cannot link to {}:{}", host, port);
+
+			auto retry = std::make_shared<boost::asio::steady_timer>(shards[0]->context, peerRetry);
+			retry->async_wait([this, index, retry](std::error_code ec)
+				{
+					if (!ec)
+						ConnectPeer(index);
+				});
+		});
+	peer.connection->SetReceivesBroadcasts(false);
 }
 
+auto IRCServer::RemoveLink(const std::shared_ptr<IRC::Connection<IRCMessageType>>& connection) -> bool
+{
+	std::scoped_lock lock(linkMutex);
+	return std::erase_if(links, [&connection](const std::shared_ptr<Link>& link) { return link->connection == connection; }) > 0;
+}
+
+auto IRCServer::IsLink(const std::shared_ptr<IRC::Connection<IRCMessageType>>& connection) const -> bool
+{
+	return std::any_of(links.begin(), links.end(), [&connection](const std::shared_ptr<Link>& link) { return link->connection == connection; });
+}
+
+auto IRCServer::RelayServerMessage(uint32_t senderID, std::string_view text, const std::shared_ptr<IRC::Connection<IRCMessageType>>& producer) -> uint64_t
+{
+	const uint64_t sequence = history.NextSequence(serverRoom);
+	auto relayed = IRC::MakeSharedMessage(IRC::Encode(Schema::ServerMessage{ .senderID = senderID,
+																			 .sequence = sequence,
+																			 .text = text }));
+	history.Append(serverRoom, relayed);
+	if (journal)
+		journal->Append(sequence, *relayed);
+	MessageAllClients(relayed, nullptr, producer);
+	return sequence;
+}
+
+// The record is encoded once and copied into each link's pending batch. Neither the link it came in
+// on nor the server it started on gets it back.
+auto IRCServer::ForwardToLinks(std::span<const uint8_t> record, uint32_t origin, const IRC::Connection<IRCMessageType>* from) -> void
+{
+	for (auto& link : links)
+	{
+		if (link->connection.get() == from || link->node == origin)
+			continue;
+
+		link->pending.insert(link->pending.end(), record.begin(), record.end());
+		link->pendingCount++;
+		linkRelaysSent.fetch_add(1, std::memory_order_relaxed);
+
+		if (link->pending.size() >= maxLinkBatchBytes)
+		{
+			FlushLink(*link);
+		}
+		else if (!link->flushPosted)
+		{
+			link->flushPosted = true;
+			boost::asio::post(shards[link->connection->GetShard()]->context, [this, link]()
+				{
+					std::scoped_lock lock(linkMutex);
+					FlushLink(*link);
+				});
+		}
+	}
+}
+
+auto IRCServer::FlushLink(Link& link) -> void
+{
+	link.flushPosted = false;
+	if (link.pendingCount == 0)
+		return;
+
+	link.connection->Send(IRC::Encode(Schema::LinkBatch{ .count = link.pendingCount, .records = link.pending }));
+	link.pending.clear();
+	link.pendingCount = 0;
+	linkBatchesSent.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto IRCServer::ProcessPing(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	IRC::Log::Trace("<{}>: Server Ping", client->GetID());
+	client->Send(msg);
+}
+
+// Server-wide messages reach links only as LinkBatch; anything else on a link is a broadcast the peer
+// sent before it knew the connection for one.
 auto IRCServer::ProcessMessageAll(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
 {
-	msg.header.id = IRCMessageType::ServerMessage;
-	msg << client->GetID();
-	MessageAllClients(msg, nullptr);
+	IRC::Log::Trace("[Server] <{}>: Message All", client->GetID());
+
+	if (!client->ReceivesBroadcasts())
+		return;
+
+	auto incoming = IRC::Decode<Schema::MessageAll>(msg);
+	if (!incoming)
+		return;
+
+	std::scoped_lock lock(historyMutex);
+	const uint64_t sequence = RelayServerMessage(client->GetID(), incoming->text, client);
+	if (node)
+	{
+		std::scoped_lock linkLock(linkMutex);
+		if (links.empty())
+			return;
+
+		relayRecord.clear();
+		IRC::EncodeInto(relayRecord, Schema::LinkRelay{ .origin = *node, .epoch = epoch, .sequence = sequence, .senderID = client->GetID(), .text = incoming->text });
+		ForwardToLinks(relayRecord, *node, nullptr);
+	}
+}
+
+auto IRCServer::ProcessJoinChannel(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	if (auto join = IRC::Decode<Schema::JoinChannel>(msg))
+	{
+		std::scoped_lock lock(channelMutex);
+		if (channels.ChannelsOf(client->GetID()) >= maxChannelsPerClient)
+		{
+			IRC::Log::Debug("[Server] <{}> Already in {} channels", client->GetID(), maxChannelsPerClient);
+			return;
+		}
+		channels.Join(join->channel, client->GetID(), client);
+	}
+}
+
+auto IRCServer::ProcessPartChannel(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	if (auto part = IRC::Decode<Schema::PartChannel>(msg))
+	{
+		std::scoped_lock lock(channelMutex);
+		channels.Part(part->channel, client->GetID());
+	}
+}
+
+auto IRCServer::ProcessChannelMessage(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto incoming = IRC::Decode<Schema::ChannelMessage>(msg);
+	if (!incoming)
+		return;
+
+	std::scoped_lock lock(channelMutex);
+	auto channel = channels.FindChannel(incoming->channel);
+	if (!channel)
+		return;
+
+	std::scoped_lock historyLock(historyMutex);
+	const auto room = static_cast<IRC::ReplayHistory<IRCMessageType>::RoomID>(*channel + 1);
+	auto relayed = IRC::MakeSharedMessage(IRC::Encode(Schema::ChannelMessage{ .senderID = client->GetID(),
+																			   .sequence = history.NextSequence(room),
+																			   .channel = incoming->channel,
+																			   .text = incoming->text }));
+	history.Append(room, relayed);
+	for (const auto& member : channels.Members(*channel))
+		member.value->Send(relayed, client);
+}
+
+// Chunks are relayed one at a time, so a transfer of any size never sits whole in the server.
+auto IRCServer::ProcessChannelData(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto incoming = IRC::Decode<Schema::ChannelData>(msg);
+	if (!incoming)
+		return;
+
+	std::scoped_lock lock(channelMutex);
+	auto channel = channels.FindChannel(incoming->channel);
+	if (!channel)
+		return;
+
+	auto relayed = IRC::Encode(Schema::ChannelData{ .senderID = client->GetID(), .channel = incoming->channel, .data = incoming->data });
+	if (IRC::IsStreamChunk(msg.header))
+		IRC::MarkStreamChunk(relayed, IRC::IsEndOfStream(msg.header));
+
+	auto shared = IRC::MakeSharedMessage(relayed);
+	for (const auto& member : channels.Members(*channel))
+		member.value->Send(shared, client);
 }
 
-void IRCServer::OnMessage(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg)
+// The stored frames go out as they are: each connection only takes another reference to them.
+// Server-wide messages older than the in-memory history come from the journal, if there is one.
+auto IRCServer::ProcessReplay(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
 {
-	switch (msg.header.id)
+	auto request = IRC::Decode<Schema::Replay>(msg);
+	if (!request)
+		return;
+
+	// The channel lock is held until the replay is done, so the channel cannot close and its room
+	// go to another channel in the meantime.
+	std::unique_lock channelLock(channelMutex, std::defer_lock);
+	std::optional<IRC::ReplayHistory<IRCMessageType>::RoomID> room = serverRoom;
+	if (!request->channel.empty())
 	{
-	case IRCMessageType::ServerPing:
-	
-		std::cout << FormatTimestamp() << "<" << client->GetID() << ">: Server Ping\n";
-		client->Send(msg);
-	
-		break;
+		channelLock.lock();
+		if (auto channel = channels.FindChannel(request->channel))
+			room = static_cast<IRC::ReplayHistory<IRCMessageType>::RoomID>(*channel + 1);
+		else
+			room.reset();
+	}
 
-	case IRCMessageType::MessageAll:
-	
-		printf("%s[Server] <%d>: Message All\n", FormatTimestamp().c_str(), client->GetID());
-		ProcessMessageAll(client, msg);
-	
-		break;
+	uint32_t sent = 0;
+	uint64_t latest = 0;
+	if (room)
+	{
+		std::scoped_lock lock(historyMutex);
+		latest = history.NextSequence(*room) - 1;
 
-	case IRCMessageType::ServerMessage:
+		if (journal && *room == serverRoom && request->since > 0 && request->since + 1 < history.OldestSequence(serverRoom))
+		{
+			sent = static_cast<uint32_t>(journal->ReadFrom(request->since + 1, maxJournalReplay, [&](const IRC::Journal::Record& record)
+				{
+					if (auto stored = IRC::EncodedMessage<IRCMessageType>::FromFrame(record.frame, record.storage))
+						client->Send(stored);
+				}));
+		}
+		else
+		{
+			auto send = [&](uint64_t, const IRC::SharedMessage<IRCMessageType>& stored) { client->Send(stored); };
+			sent = static_cast<uint32_t>(request->since > 0 ? history.Since(*room, request->since, send) : history.Last(*room, request->count, send));
+		}
+	}
 
-		std::cout << FormatTimestamp() << "[Server] <" << client->GetID() << ">: Server Message\n";
-		ProcessMessageAll(client, msg);
+	client->Send(IRC::Encode(Schema::Replay{ .channel = request->channel, .count = sent, .since = latest }));
+}
+
+// Only answered for clients on this machine: the report describes every connection and link.
+auto IRCServer::ProcessAdminMetrics(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>&) -> void
+{
+	if (!client->IsLocal())
+	{
+		IRC::Log::Warning("[Server] <{}> Refused a metrics request from a remote client", client->GetID());
+		return;
+	}
+
+	const std::string report = IRC::FormatMetrics(GetMetrics(), nullptr, IRC::MetricsFormat::json);
+	client->Send(IRC::Encode(Schema::AdminMetrics{ .report = report }));
+}
+
+auto IRCServer::ProcessClientHello(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto hello = IRC::Decode<Schema::ClientHello>(msg);
+	if (!hello)
+		return;
+
+	const uint32_t agreed = hello->capabilities & capabilities;
+	if (agreed & IRC::Capability::compression)
+		client->EnableCompression(compressionThreshold);
+	if (agreed & IRC::Capability::compactFraming)
+		client->UpgradeFraming();
+}
+
+// On a connection to a peer, the accept is the cue to ask for the link.
+auto IRCServer::ProcessServerAccept(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto accept = IRC::Decode<Schema::ServerAccept>(msg);
+	if (!accept || !node)
+		return;
+
+	std::scoped_lock lock(linkMutex);
+	if (std::none_of(peers.begin(), peers.end(), [&client](const Peer& peer) { return peer.connection == client; }))
+		return;
+
+	if (accept->capabilities & IRC::Capability::compression)
+	{
+		client->Send(IRC::Encode(Schema::ClientHello{ .capabilities = IRC::Capability::compression }));
+		client->EnableCompression(compressionThreshold);
+	}
+	client->Send(IRC::Encode(Schema::LinkHello{ .node = *node, .epoch = epoch, .secret = linkSecret }));
+}
+
+// The side that was connected to answers with its own hello; the side that connected already sent one.
+// Either side drops a connection whose hello lacks the link secret, so an ordinary client cannot
+// pose as a server.
+auto IRCServer::ProcessLinkHello(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto hello = IRC::Decode<Schema::LinkHello>(msg);
+	if (!hello || !node || hello->node == *node || !SecretsMatch(linkSecret, hello->secret))
+	{
+		IRC::Log::Warning("[Federation] <{}> Refused a link from node {}", client->GetID(), hello ? hello->node : 0);
+		client->Disconnect();
+		return;
+	}
+
+	std::scoped_lock lock(linkMutex);
+	if (IsLink(client))
+		return;
+
+	client->SetReceivesBroadcasts(false);
+	auto link = std::make_shared<Link>();
+	link->connection = client;
+	link->node = hello->node;
+	links.push_back(std::move(link));
+	if (std::none_of(peers.begin(), peers.end(), [&client](const Peer& peer) { return peer.connection == client; }))
+		client->Send(IRC::Encode(Schema::LinkHello{ .node = *node, .epoch = epoch, .secret = linkSecret }));
+
+	IRC::Log::Info("[Federation] Linked to node {}", hello->node);
+}
+
+// Every server relays a message once, however many paths bring it, and passes it on to all its
+// links but the one it came in on. The records go on as they arrived, without encoding them again.
+auto IRCServer::ProcessLinkBatch(std::shared_ptr<IRC::Connection<IRCMessageType>> client, IRC::Message<IRCMessageType>& msg) -> void
+{
+	auto batch = IRC::Decode<Schema::LinkBatch>(msg);
+	if (!batch)
+		return;
+
+	std::scoped_lock lock(historyMutex);
+	std::scoped_lock linkLock(linkMutex);
+	if (!IsLink(client))
+	{
+		IRC::Log::Warning("[Federation] <{}> Sent a link batch without a link", client->GetID());
+		client->Disconnect();
+		return;
+	}
+
+	const uint8_t* in = batch->records.data();
+	const uint8_t* end = in + batch->records.size();
+	for (uint32_t index = 0; index < batch->count; index++)
+	{
+		const uint8_t* recordStart = in;
+		auto relay = IRC::DecodeFrom<Schema::LinkRelay>(in, end);
+		if (!relay)
+		{
+			IRC::Log::Warning("[Federation] <{}> Malformed link batch", client->GetID());
+			break;
+		}
 
-		break;
+		linkRelaysReceived.fetch_add(1, std::memory_order_relaxed);
+		if (relay->origin == *node || !duplicates.Accept(relay->origin, relay->epoch, relay->sequence))
+		{
+			linkDuplicates.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
 
+		RelayServerMessage(relay->senderID, relay->text, client);
+		ForwardToLinks(std::span<const uint8_t>(recordStart, in), relay->origin, client.get());
 	}
 }
 
@@ -1,10 +1,134 @@
 ﻿#include "Server.h"
 
-int main()
+#include <Framework/Log.h>
+
+#include <cstdlib>
+#include <string_view>
+
+static auto PrintUsage() -> void
+{
+	std::cout << "Usage: Server [--port P] [--shards N] [--log trace|debug|info|warning|error] [--metrics PATH]\n"
+				 "              [--inline] [--workers N] [--heartbeat SECONDS] [--journal DIR]\n"
+				 "              [--durability os|interval|immediate] [--node ID --link-secret SECRET] [--peer HOST:PORT ...]\n";
+}
+
+int main(int argc, char* argv[])
 {
-	IRCServer server(60000);
+	uint16_t port = 60000;
+	uint32_t shards = 1;
+	// Answers pings and metrics requests on the shard threads instead of via Update.
+	bool inlineDispatch = false;
+	// Handler worker threads; 0 leaves message handling on the main thread's Update loop.
+	size_t workers = 0;
+	// Seconds of silence before a heartbeat; the idle timeout is three of them, and 0 turns both off.
+	std::optional<double> heartbeat;
+	// A metrics path ending in .json gets JSON, anything else plain text.
+	std::string metricsPath;
+	std::optional<IRC::JournalOptions> journal;
+	IRC::JournalDurability durability = IRC::JournalDurability::interval;
+	// A node ID joins a network of servers, linked to each --peer; all of them share the link secret.
+	std::optional<uint32_t> node;
+	std::string linkSecret;
+	std::vector<std::pair<std::string, uint16_t>> peers;
+
+	for (int index = 1; index < argc; index++)
+	{
+		const std::string_view flag = argv[index];
+		if (flag == "--inline")
+		{
+			inlineDispatch = true;
+			continue;
+		}
+
+		if (index + 1 >= argc)
+		{
+			PrintUsage();
+			return 1;
+		}
+
+		const std::string_view value = argv[++index];
+		if (flag == "--port")
+			port = static_cast<uint16_t>(std::atoi(value.data()));
+		else if (flag == "--shards")
+			shards = static_cast<uint32_t>(std::atoi(value.data()));
+		else if (flag == "--log")
+		{
+			if (auto level = IRC::Log::ParseLevel(value))
+				IRC::Log::SetLevel(*level);
+		}
+		else if (flag == "--metrics")
+			metricsPath = value;
+		else if (flag == "--workers")
+			workers = std::strtoull(value.data(), nullptr, 10);
+		else if (flag == "--heartbeat")
+			heartbeat = std::atof(value.data());
+		else if (flag == "--journal")
+			journal = IRC::JournalOptions{ .directory = value };
+		else if (flag == "--durability")
+			durability = value == "os" ? IRC::JournalDurability::os
+					   : value == "immediate" ? IRC::JournalDurability::immediate
+					   : IRC::JournalDurability::interval;
+		else if (flag == "--node")
+			node = static_cast<uint32_t>(std::atoi(value.data()));
+		else if (flag == "--link-secret")
+			linkSecret = value;
+		else if (flag == "--peer")
+		{
+			const size_t colon = value.rfind(':');
+			if (colon == std::string_view::npos)
+			{
+				IRC::Log::Warning("[Server] Peer {} is not host:port", value);
+				continue;
+			}
+			peers.emplace_back(std::string(value.substr(0, colon)), static_cast<uint16_t>(std::atoi(value.data() + colon + 1)));
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (node && linkSecret.empty())
+	{
+		IRC::Log::Error("[Server] --node needs a --link-secret");
+		return 1;
+	}
+
+	IRCServer server(port, shards, inlineDispatch);
+	server.SetHandlerWorkers(workers);
+
+	if (heartbeat)
+	{
+		const std::chrono::milliseconds interval(static_cast<int64_t>(*heartbeat * 1000));
+		server.SetHeartbeat(interval, 3 * interval);
+	}
+
+	if (journal)
+	{
+		journal->durability = durability;
+		server.EnableJournal(std::move(*journal));
+	}
+
+	if (node)
+	{
+		server.EnableFederation(*node, linkSecret);
+		for (auto& [host, peerPort] : peers)
+			server.AddPeer(host, peerPort);
+	}
+	else if (!peers.empty())
+	{
+		IRC::Log::Warning("[Server] --peer needs a --node");
+	}
+
+	if (!metricsPath.empty())
+	{
+		const bool json = metricsPath.ends_with(".json");
+		server.StartMetricsDump(metricsPath, std::chrono::seconds(1), json ? IRC::MetricsFormat::json : IRC::MetricsFormat::text);
+	}
+
 	server.Start();
 	server.Run();
 
 	return 0;
-}
\ No newline at end of file
+}
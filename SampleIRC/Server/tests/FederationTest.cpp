@@ -0,0 +1,142 @@
+#include "Server.h"
+
+#include <Framework/Client.h>
+#include <Framework/MessageSchemas.h>
+
+#include <cstdio>
+
+// Three servers all linked to each other, with a client on each. A MessageAll sent to A reaches B
+// and C both straight from A and passed on by the other, so each has to drop the second copy: every
+// client must see the message exactly once, and the servers must report the duplicates they dropped.
+namespace
+{
+	constexpr uint16_t basePort = 63100;
+	constexpr const char* secret = "federation-test";
+
+	// Records which ServerMessage texts have arrived, from the client's I/O thread.
+	class WatchingClient : public IRC::IClient<IRCMessageType>
+	{
+	public:
+		WatchingClient()
+		{
+			SetMessageHandler([this](IRC::IdentifyingMessage<IRCMessageType>& incoming)
+				{
+					if (incoming.msg.header.id == IRCMessageType::ServerAccept)
+						accepted = true;
+
+					if (auto relayed = IRC::Decode<Schema::ServerMessage>(incoming.msg))
+					{
+						std::scoped_lock lock(mutex);
+						texts.emplace_back(relayed->text);
+					}
+				});
+		}
+
+		auto TimesReceived(std::string_view text) -> size_t
+		{
+			std::scoped_lock lock(mutex);
+			return static_cast<size_t>(std::count(texts.begin(), texts.end(), text));
+		}
+
+		std::atomic<bool> accepted = false;
+
+	private:
+		std::mutex mutex;
+		std::vector<std::string> texts;
+	};
+
+	template<typename Predicate>
+	auto WaitUntil(Predicate predicate, std::chrono::seconds timeout) -> bool
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!predicate())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	std::array<std::unique_ptr<IRCServer>, 3> servers;
+	for (uint32_t index = 0; index < servers.size(); index++)
+	{
+		servers[index] = std::make_unique<IRCServer>(static_cast<uint16_t>(basePort + index));
+		servers[index]->SetHandlerWorkers(1);
+		servers[index]->EnableFederation(index + 1, secret);
+		if (!servers[index]->Start())
+		{
+			fprintf(stderr, "federation: server %u did not start\n", index + 1);
+			return 1;
+		}
+	}
+	servers[0]->AddPeer("127.0.0.1", basePort + 2);
+	servers[1]->AddPeer("127.0.0.1", basePort);
+	servers[2]->AddPeer("127.0.0.1", basePort + 1);
+
+	const std::array<uint64_t, 3> expectedLinks = { 2, 2, 2 };
+	for (size_t index = 0; index < servers.size(); index++)
+	{
+		if (!WaitUntil([&]() { return servers[index]->GetMetrics().federationLinks == expectedLinks[index]; }, std::chrono::seconds(10)))
+		{
+			fprintf(stderr, "federation: server %zu has %llu links, expected %llu\n", index + 1,
+				static_cast<unsigned long long>(servers[index]->GetMetrics().federationLinks), static_cast<unsigned long long>(expectedLinks[index]));
+			return 1;
+		}
+	}
+
+	std::array<std::unique_ptr<WatchingClient>, 3> clients;
+	for (size_t index = 0; index < clients.size(); index++)
+	{
+		clients[index] = std::make_unique<WatchingClient>();
+		if (!clients[index]->Connect("127.0.0.1", static_cast<uint16_t>(basePort + index))
+			|| !WaitUntil([&]() { return clients[index]->accepted.load(); }, std::chrono::seconds(10)))
+		{
+			fprintf(stderr, "federation: client on server %zu was not accepted\n", index + 1);
+			return 1;
+		}
+	}
+
+	const std::string_view text = "hello from node 1";
+	clients[0]->Send(IRC::Encode(Schema::MessageAll{ .text = text }));
+
+	for (size_t index = 0; index < clients.size(); index++)
+	{
+		if (!WaitUntil([&]() { return clients[index]->TimesReceived(text) > 0; }, std::chrono::seconds(10)))
+		{
+			fprintf(stderr, "federation: the message from node 1 never reached the client on node %zu\n", index + 1);
+			return 1;
+		}
+	}
+
+	// The second copy takes the longer way round; give it time to arrive and be dropped.
+	const auto duplicatesDropped = [&]()
+		{
+			uint64_t dropped = 0;
+			for (auto& server : servers)
+				dropped += server->GetMetrics().linkDuplicates;
+			return dropped;
+		};
+	if (!WaitUntil([&]() { return duplicatesDropped() > 0; }, std::chrono::seconds(10)))
+	{
+		fprintf(stderr, "federation: no server dropped a duplicate relay\n");
+		return 1;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	for (size_t index = 0; index < clients.size(); index++)
+	{
+		if (const size_t times = clients[index]->TimesReceived(text); times != 1)
+		{
+			fprintf(stderr, "federation: the client on node %zu got the message %zu times\n", index + 1, times);
+			return 1;
+		}
+	}
+
+	clients = {};
+	servers = {};
+	return 0;
+}